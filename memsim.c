@@ -3,6 +3,13 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/wait.h>
 #include "linkedList.h"
 
 #define FILENAME_MAX_LENGTH 64
@@ -23,17 +30,179 @@
 #define V_BIT_POSITION 15
 #define R_BIT_POSITION 14
 #define M_BIT_POSITION 13
+#define H_BIT_POSITION 12
+#define BUSY_BIT_POSITION 11
 
 #define ALGO_NAME_MAX_SIZE 6
 #define MEM_REF_MAX_SIZE 15
+#define WEIGHTED_REF_MAX_SIZE 40
 #define ECLOCK_STEP_AMOUNT 4
 
+#define CHECKPOINT_MAGIC "MSCK"
+#define CHECKPOINT_VERSION 6
+
+#define OPT_CHECKPOINT 256
+#define OPT_CHECKPOINT_EVERY 257
+#define OPT_RESUME 258
+#define OPT_REDUCE 259
+#define OPT_REDUCE_FRAMES 260
+#define OPT_WEIGHTED 261
+#define OPT_VALIDATE_REDUCED 262
+
+#define OPT_SAMPLE_RATE 263
+#define OPT_MRC 264
+#define OPT_SAMPLE_VERIFY 265
+
+#define REDUCED_TRACE_HEADER "#memsim-reduced"
+
+#define SAMPLE_HASH_BITS 24
+#define SAMPLE_HASH_MULTIPLIER 2654435761u
+#define MRC_MIN_FRAMES 4
+#define MRC_MAX_FRAMES 128
+#define MRC_FRAME_STEP 4
+#define MRC_CONFIDENCE_Z 1.96
+
+#define OPT_HUGE_PAGES 266
+#define OPT_TLB_ENTRIES 267
+
+#define TLB_MAX_ENTRIES 64
+
+#define OPT_SPARSE_SWAP 268
+
+#define SWAP_INDEX_SUFFIX ".index"
+#define SWAP_COMPACT_MIN_SLOTS 16
+
+#define OPT_METRICS 269
+#define OPT_METRICS_EVERY 270
+#define OPT_METRICS_FORMAT 271
+
+#define METRICS_RING_SIZE 256
+#define METRICS_MAX_INNER_TABLES 32
+
+#define OPT_THREADS 272
+#define OPT_THREAD_TRACE 273
+
+#define CONCURRENT_MAX_THREADS 16
+#define THREAD_REFERENCE_BUFFER_SIZE 16
+#define TLB_HUGE_KEY 0x8000
+
+#define OPT_SLOW_FRAMES 274
+#define OPT_FAST_COST 275
+#define OPT_SLOW_COST 276
+#define OPT_FAULT_COST 277
+
+// Default access costs in nanoseconds: DRAM, CXL/PMEM-like memory and a swap-in from disk
+#define TIER_FAST_COST 100
+#define TIER_SLOW_COST 300
+#define TIER_FAULT_COST 100000
+
+#define OPT_DIFF 278
+
 // Structs
 struct frame
 {
     char frameData[PAGE_SIZE_BYTES];
 };
 
+// Fixed-size part of a checkpoint file, followed by the page tables, the
+// allocated inner tables, the used frames, the replacement list (head first),
+// the non-zero swap pages and the slow tier
+struct checkpointHeader
+{
+    char magic[4];
+    int version;
+    int pageOption;
+    int frameNumber;
+    int tick;
+    int hugePageThreshold;
+    int tlbEntries;
+    char algorithmName[ALGO_NAME_MAX_SIZE + 1];
+    int initialFrameCounter;
+    int referenceCounter;
+    int totalPageFaultCounter;
+    long totalReferenceCounter;
+    long traceOffset;
+    long outputOffset;
+    int promotionCounter;
+    int demotionCounter;
+    int prefetchCounter;
+    int tlbEntryAmount;
+    long tlbHitCounter;
+    long tlbMissCounter;
+    double tlbReachSum;
+    unsigned short tlbKeys[TLB_MAX_ENTRIES];
+    int listLength;
+    int innerTableCount;
+    int swapPageCount;
+    int sparseSwap;
+    int swapSlotAmount;
+    int freeSlotAmount;
+    long zeroFillCounter;
+    int writeBackCounter;
+    int windowPageFaultStart;
+    int windowWriteBackStart;
+    long windowReferenceStart;
+    long metricsOffset;
+    int slowFrameNumber;
+    int slowTierHand;
+    long fastAccessCounter;
+    long slowAccessCounter;
+    int tierPromotionCounter;
+    int tierDemotionCounter;
+    int slowEvictionCounter;
+    double accessCostSum;
+};
+
+// One sample of the metrics time series
+struct metricsSample
+{
+    long reference;
+    long windowReferences;
+    int windowPageFaults;
+    int windowWriteBacks;
+    int residentFrames;
+    int dirtyFrames;
+    int workingSetSize;
+    unsigned char innerTableResidency[METRICS_MAX_INNER_TABLES];
+};
+
+// One record of a reduced trace, standing for weight consecutive references
+struct weightedReference
+{
+    char mode;
+    unsigned short virtualAddress;
+    unsigned short value;
+    long weight;
+};
+
+// One reference as seen by an engine of the differential mode (pageFault is -1 after the last one)
+struct differentialRecord
+{
+    unsigned short virtualAddress;
+    unsigned short pfn;
+    int pageFault;
+    int victimVpn;
+};
+
+// Per-thread state of the concurrent mode
+struct threadContext
+{
+    pthread_t thread;
+    struct weightedReference *references;
+    long referenceAmount;
+    unsigned short referenceBuffer[THREAD_REFERENCE_BUFFER_SIZE];
+    int referenceBufferAmount;
+
+    // Contention counters
+    long pageFaults;
+    long writeBacks;
+    long handCasRetries;
+    long referenceClearFailures;
+    long evictionClaimFailures;
+    long faultWaits;
+    long frameLockSpins;
+};
+
 // Create & Initialize Variables
 struct frame *physicalMemory;
 unsigned short *singlePageTable;
@@ -57,17 +226,97 @@ int INNER_TABLE_AMOUNT;
 int INNER_TABLE_PAGE_SIZE;
 int TICK;
 int PAGE_OPTION;
+long CHECKPOINT_INTERVAL;
+int REDUCE_FRAMES;
+int WEIGHTED_TRACE;
+double SAMPLE_RATE;
+int SAMPLE_VERIFY;
+int HUGE_PAGE_THRESHOLD;
+int TLB_ENTRIES;
+int SPARSE_SWAP;
+long METRICS_INTERVAL;
+int METRICS_JSON;
+int THREAD_AMOUNT;
+int THREAD_TRACE_AMOUNT;
+int SLOW_FRAME_NUMBER;
+double FAST_ACCESS_COST = TIER_FAST_COST;
+double SLOW_ACCESS_COST = TIER_SLOW_COST;
+double FAULT_ACCESS_COST = TIER_FAULT_COST;
+int DIFFERENTIAL;
 
 // Variables
 int initialFrameCounter;
 int referenceCounter;
 int totalPageFaultCounter;
+long totalReferenceCounter;
+long resumeOutputOffset;
+int pageFaultCounter[PAGE_AMOUNT];
+int promotionCounter;
+int demotionCounter;
+int prefetchCounter;
+
+// TLB (most recently used key first)
+unsigned short tlbKeys[TLB_MAX_ENTRIES];
+int tlbEntryAmount;
+long tlbHitCounter;
+long tlbMissCounter;
+double tlbReachSum;
+
+// Sparse swap store: slot of every page (-1 if never swapped out) and the free slots below swapSlotAmount
+int swapSlot[PAGE_AMOUNT];
+int freeSlots[PAGE_AMOUNT];
+int freeSlotAmount;
+int swapSlotAmount;
+long zeroFillCounter;
+
+// Metrics time series, buffered in a ring and written out when it fills up
+FILE *metricsFile;
+struct metricsSample metricsRing[METRICS_RING_SIZE];
+int metricsRingAmount;
+int writeBackCounter;
+int windowPageFaultStart;
+int windowWriteBackStart;
+long windowReferenceStart;
+long lastReferenceTime[PAGE_AMOUNT];
+long resumeMetricsOffset;
+
+// Concurrent mode: one flat page table and frame pool shared by all threads
+_Atomic unsigned short *concurrentPageTable;
+_Atomic int *frameOwner;
+atomic_flag *frameLocks;
+_Atomic int nextFreeFrame;
+_Atomic int clockHand;
+
+// Slow memory tier (slowTierFrame is -1 for pages not held there)
+struct frame *slowMemory;
+int slowTierFrame[PAGE_AMOUNT];
+int *slowFrameOwner;
+int slowTierHand;
+long fastAccessCounter;
+long slowAccessCounter;
+int tierPromotionCounter;
+int tierDemotionCounter;
+int slowEvictionCounter;
+double accessCostSum;
+
+// Differential mode
+FILE *differentialPipe;
+int differentialControl;
+const char *differentialEngineName;
+int lastVictimVpn;
 
 // String Buffers
 char ALGORITHM_NAME[ALGO_NAME_MAX_SIZE + 1];
 char SWAPFILE_FILENAME[FILENAME_MAX_LENGTH];
 char REFERENCE_FILENAME[FILENAME_MAX_LENGTH];
 char OUTPUT_FILENAME[FILENAME_MAX_LENGTH];
+char CHECKPOINT_FILENAME[FILENAME_MAX_LENGTH];
+char RESUME_FILENAME[FILENAME_MAX_LENGTH];
+char REDUCED_FILENAME[FILENAME_MAX_LENGTH];
+char VALIDATE_FILENAME[FILENAME_MAX_LENGTH];
+char MRC_FILENAME[FILENAME_MAX_LENGTH];
+char METRICS_FILENAME[FILENAME_MAX_LENGTH];
+char THREAD_TRACE_FILENAMES[CONCURRENT_MAX_THREADS][FILENAME_MAX_LENGTH];
 
 unsigned short referenceExtraction(char *memoryReference, char *mode, unsigned short *value)
 {
@@ -179,292 +428,2650 @@ unsigned short algorithmEclock(struct Node **circularListHead, unsigned short vp
     return victimPage;
 }
 
-void clearReferencedBits()
+
+// Open a file for writing, or continue it from a checkpoint offset if it still holds that much
+FILE *openResumableFile(const char *filename, long offset, int *continued)
 {
-    referenceCounter++;
-    if (referenceCounter == TICK)
+    FILE *file = NULL;
+
+    *continued = 0;
+    if (offset > 0)
     {
-        if (PAGE_OPTION == 1)
+        file = fopen(filename, "r+");
+        if (file != NULL)
         {
-            for (int i = 0; i < PAGE_AMOUNT; i++)
+            fseek(file, 0, SEEK_END);
+            if (ftell(file) < offset || ftruncate(fileno(file), offset) != 0)
             {
-                singlePageTable[i] = writeBits(singlePageTable[i], 1, R_BIT_POSITION, 0);
+                fclose(file);
+                file = NULL;
             }
-        }
-        else if (PAGE_OPTION == 2)
-        {
-            for (int i = 0; i < INNER_TABLE_AMOUNT; i++)
+            else
             {
-                if (innerTablesTable[i] != NULL)
-                {
-                    for (int j = 0; j < INNER_TABLE_PAGE_SIZE; j++)
-                    {
-                        (innerTablesTable[i])[j] = writeBits((innerTablesTable[i])[j], 1, R_BIT_POSITION, 0);
-                    }
-                }
+                fseek(file, offset, SEEK_SET);
+                *continued = 1;
             }
         }
-        referenceCounter = 0;
     }
+    if (file == NULL)
+    {
+        file = fopen(filename, "w+");
+    }
+    if (file == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+    return file;
 }
 
-void processMemoryReferences()
+void writeEmptySwapImage(FILE *file)
 {
-    char memoryReference[MEM_REF_MAX_SIZE];
-    char mode;
-    unsigned short value;
-    unsigned short virtualAddress;
+    char intialData[VM_SIZE_BYTES];
 
-    unsigned short vpn;
-    unsigned short vpnP1;
-    unsigned short vpnP2;
-    unsigned short offset;
+    for (int i = 0; i < VM_SIZE_BYTES; i++)
+    {
+        intialData[i] = 0;
+    }
 
-    unsigned short physicalAddress;
+    fwrite(intialData, sizeof(intialData), 1, file);
+}
 
-    int pageFault;
+// Start from an all-zero swap: a full image for the fixed layout, an empty file and index for the sparse one
+void resetSwapStore()
+{
+    rewind(swapFile);
+    if (!SPARSE_SWAP)
+    {
+        writeEmptySwapImage(swapFile);
+        return;
+    }
 
-    while (fgets(memoryReference, MEM_REF_MAX_SIZE, referenceFile) != NULL)
+    fflush(swapFile);
+    if (ftruncate(fileno(swapFile), 0) != 0)
     {
-        // Initially no page fault is assumes
-        pageFault = 0;
+        perror("ftruncate");
+        exit(1);
+    }
+    for (int i = 0; i < PAGE_AMOUNT; i++)
+    {
+        swapSlot[i] = -1;
+    }
+    freeSlotAmount = 0;
+    swapSlotAmount = 0;
+}
 
-        // Remove newline character from memory reference
-        memoryReference[strcspn(memoryReference, "\n")] = 0;
+void swapRead(unsigned short vpn, char *pageData)
+{
+    if (SPARSE_SWAP && swapSlot[vpn] < 0)
+    {
+        // Never swapped out, so it is still all zeroes: no disk access
+        memset(pageData, 0, PAGE_SIZE_BYTES);
+        zeroFillCounter++;
+        return;
+    }
+
+    fseek(swapFile, (long)PAGE_SIZE_BYTES * (SPARSE_SWAP ? swapSlot[vpn] : vpn), SEEK_SET);
+    if (fread(pageData, PAGE_SIZE_BYTES, 1, swapFile) != 1)
+    {
+        memset(pageData, 0, PAGE_SIZE_BYTES);
+    }
+}
 
-        // Extract virtual address, mode and value from memory reference
-        virtualAddress = referenceExtraction(memoryReference, &mode, &value);
+void swapWrite(unsigned short vpn, char *pageData)
+{
+    if (SPARSE_SWAP && swapSlot[vpn] < 0)
+    {
+        // Allocate a slot on first swap-out, reusing freed ones first
+        swapSlot[vpn] = freeSlotAmount > 0 ? freeSlots[--freeSlotAmount] : swapSlotAmount++;
+    }
 
-        // Extract virtual page number (VPN) and offset
-        vpn = extractBits(virtualAddress, VA_VPN_BITS, VA_OFFSET_BITS);
-        vpnP1 = extractBits(virtualAddress, TWO_LEVEL_VPN_P1_BITS, VA_OFFSET_BITS + TWO_LEVEL_VPN_P2_BITS);
-        vpnP2 = extractBits(virtualAddress, TWO_LEVEL_VPN_P2_BITS, VA_OFFSET_BITS);
-        offset = extractBits(virtualAddress, VA_OFFSET_BITS, 0);
+    fseek(swapFile, (long)PAGE_SIZE_BYTES * (SPARSE_SWAP ? swapSlot[vpn] : vpn), SEEK_SET);
+    fwrite(pageData, PAGE_SIZE_BYTES, 1, swapFile);
+}
 
-        unsigned short *innerTable;
-        unsigned short vBit;
-        unsigned short pfn;
-        unsigned short innerTableVpnIndex;
+// Move the used slots down over the free ones and shrink the file
+void compactSwapStore()
+{
+    char pageData[PAGE_SIZE_BYTES];
+    int slotOwner[PAGE_AMOUNT];
+    int newSlotAmount = 0;
 
-        // Assign the page table and validation bit
-        if (PAGE_OPTION == 1)
+    for (int i = 0; i < swapSlotAmount; i++)
+    {
+        slotOwner[i] = -1;
+    }
+    for (int i = 0; i < PAGE_AMOUNT; i++)
+    {
+        if (swapSlot[i] >= 0)
         {
-            innerTable = singlePageTable;
-            vBit = extractBits(singlePageTable[vpn], 1, V_BIT_POSITION);
-            innerTableVpnIndex = vpn;
+            slotOwner[swapSlot[i]] = i;
         }
-        else if (PAGE_OPTION == 2)
-        {
-            unsigned short vBitP1 = extractBits(outerPageTable[vpnP1], 1, V_BIT_POSITION);
-
-            // Create inner table if not exists
-            if (vBitP1 == 0 && innerTablesTable[vpnP1] == NULL)
-            {
-                innerTablesTable[vpnP1] = (unsigned short *)malloc(sizeof(unsigned short) * INNER_TABLE_PAGE_SIZE);
-
-                // Initialize inner table with all zeroes
-                unsigned short zeroMask = 0x0000;
-                for (int i = 0; i < INNER_TABLE_PAGE_SIZE; i++)
-                {
-                    (innerTablesTable[vpnP1])[i] &= zeroMask;
-                }
-
-                outerPageTable[vpnP1] = writeBits(outerPageTable[vpnP1], 1, V_BIT_POSITION, 1);
-                outerPageTable[vpnP1] = writeBits(outerPageTable[vpnP1], TWO_LEVEL_VPN_P1_BITS, 0, vpnP1);
-            }
+    }
 
-            innerTable = innerTablesTable[vpnP1];
-            vBit = extractBits(innerTable[vpnP2], 1, V_BIT_POSITION);
-            innerTableVpnIndex = vpnP2;
+    // Slots only move towards the start, so copying in slot order never overwrites a live slot
+    for (int slot = 0; slot < swapSlotAmount; slot++)
+    {
+        if (slotOwner[slot] < 0)
+        {
+            continue;
         }
-
-        // Page fault
-        if (vBit == 0)
+        if (slot != newSlotAmount)
         {
-            unsigned short victimPageVpn;
-            unsigned short victimPageIndexVpn;
-            unsigned short *victimInnerTable;
-
-            unsigned short replacedFramePfn;
-            char pageData[PAGE_SIZE_BYTES];
+            fseek(swapFile, (long)PAGE_SIZE_BYTES * slot, SEEK_SET);
+            fread(pageData, PAGE_SIZE_BYTES, 1, swapFile);
+            fseek(swapFile, (long)PAGE_SIZE_BYTES * newSlotAmount, SEEK_SET);
+            fwrite(pageData, PAGE_SIZE_BYTES, 1, swapFile);
+            swapSlot[slotOwner[slot]] = newSlotAmount;
+        }
+        newSlotAmount++;
+    }
 
-            // Mark page fault
-            pageFault = 1;
-            totalPageFaultCounter++;
+    fflush(swapFile);
+    if (ftruncate(fileno(swapFile), (long)PAGE_SIZE_BYTES * newSlotAmount) != 0)
+    {
+        perror("ftruncate");
+        exit(1);
+    }
+    swapSlotAmount = newSlotAmount;
+    freeSlotAmount = 0;
+}
 
-            // CASE 1: Empty frame exists
-            if (initialFrameCounter < FRAME_NUMBER)
-            {
-                // Insert the node to reference string queue depending on the used algorithm
-                if (strcmp(ALGORITHM_NAME, "LRU") == 0)
-                {
-                    insertNode(&lruListHead, &lruListTail, vpn);
-                }
-                else
-                {
-                    circularInsertNode(&circularListHead, vpn);
-                }
+// The page is dirty in memory and will be written back on eviction, so its slot is stale
+void swapRelease(unsigned short vpn)
+{
+    if (!SPARSE_SWAP || swapSlot[vpn] < 0)
+    {
+        return;
+    }
 
-                replacedFramePfn = initialFrameCounter;
-                initialFrameCounter++;
-            }
-            // CASE 2: Page replacement
-            else
-            {
-                // Find victim page depending on the replacement algorithm
-                if (strcmp(ALGORITHM_NAME, "FIFO") == 0)
-                {
-                    victimPageVpn = algorithmFifo(&circularListHead, vpn);
-                }
-                else if (strcmp(ALGORITHM_NAME, "LRU") == 0)
-                {
-                    victimPageVpn = algorithmLru(&lruListTail, vpn);
-                }
-                else if (strcmp(ALGORITHM_NAME, "CLOCK") == 0)
-                {
-                    victimPageVpn = algorithmClock(&circularListHead, vpn, innerTable);
-                }
-                else if (strcmp(ALGORITHM_NAME, "ECLOCK") == 0)
-                {
-                    victimPageVpn = algorithmEclock(&circularListHead, vpn, innerTable);
-                }
+    freeSlots[freeSlotAmount++] = swapSlot[vpn];
+    swapSlot[vpn] = -1;
 
-                // Victim Table and VPN operations
-                if (PAGE_OPTION == 1)
-                {
-                    victimInnerTable = innerTable;
-                    victimPageIndexVpn = victimPageVpn;
-                }
-                else if (PAGE_OPTION == 2)
-                {
-                    unsigned short victimPageVpnP1 = extractBits(victimPageVpn, TWO_LEVEL_VPN_P1_BITS, TWO_LEVEL_VPN_P2_BITS);
-                    unsigned short victimPageVpnP2 = extractBits(victimPageVpn, TWO_LEVEL_VPN_P2_BITS, 0);
+    if (swapSlotAmount >= SWAP_COMPACT_MIN_SLOTS && freeSlotAmount * 2 > swapSlotAmount)
+    {
+        compactSwapStore();
+    }
+}
 
-                    victimInnerTable = innerTablesTable[victimPageVpnP1];
-                    victimPageIndexVpn = victimPageVpnP2;
-                }
+void writeSwapIndex()
+{
+    char indexFilename[FILENAME_MAX_LENGTH + sizeof(SWAP_INDEX_SUFFIX)];
 
-                // Extract PFN of victim page
-                replacedFramePfn = extractBits(victimInnerTable[victimPageIndexVpn], PFN_BIT_SIZE, 0);
+    sprintf(indexFilename, "%s%s", SWAPFILE_FILENAME, SWAP_INDEX_SUFFIX);
+    FILE *indexFile = fopen(indexFilename, "w");
+    if (indexFile == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+    for (int i = 0; i < PAGE_AMOUNT; i++)
+    {
+        if (swapSlot[i] >= 0)
+        {
+            fprintf(indexFile, "0x%hx %d\n", (unsigned short)i, swapSlot[i]);
+        }
+    }
+    fclose(indexFile);
+}
 
-                // Save the victim page to swapfile if it is modified
-                unsigned short bitM = extractBits(victimInnerTable[victimPageIndexVpn], 1, M_BIT_POSITION);
-                if (bitM == 1)
-                {
-                    fseek(swapFile, PAGE_SIZE_BYTES * victimPageVpn, SEEK_SET);
-                    fwrite(physicalMemory[replacedFramePfn].frameData, PAGE_SIZE_BYTES, 1, swapFile);
-                }
+// Reload the layout of an existing sparse store from its index, returns 0 when there is no index
+int loadSwapIndex()
+{
+    char indexFilename[FILENAME_MAX_LENGTH + sizeof(SWAP_INDEX_SUFFIX)];
+    int slotOwner[PAGE_AMOUNT];
+    unsigned short vpn;
+    int slot;
 
-                // Change V bit to 0 for victim page
-                victimInnerTable[victimPageIndexVpn] = writeBits(victimInnerTable[victimPageIndexVpn], 1, V_BIT_POSITION, 0);
-            }
+    sprintf(indexFilename, "%s%s", SWAPFILE_FILENAME, SWAP_INDEX_SUFFIX);
+    FILE *indexFile = fopen(indexFilename, "r");
+    if (indexFile == NULL)
+    {
+        return 0;
+    }
 
-            // Page Fault Operations
-            innerTable[innerTableVpnIndex] = writeBits(innerTable[innerTableVpnIndex], 1, V_BIT_POSITION, 1);
-            innerTable[innerTableVpnIndex] = writeBits(innerTable[innerTableVpnIndex], 1, M_BIT_POSITION, 0);
-            innerTable[innerTableVpnIndex] = writeBits(innerTable[innerTableVpnIndex], 1, R_BIT_POSITION, 1);
-            innerTable[innerTableVpnIndex] = writeBits(innerTable[innerTableVpnIndex], PFN_BIT_SIZE, 0, replacedFramePfn);
+    fseek(swapFile, 0, SEEK_END);
+    long fileSlotAmount = ftell(swapFile) / PAGE_SIZE_BYTES;
 
-            // Read the desired page data from swapfile and overwrite on the victim page's frame
-            fseek(swapFile, PAGE_SIZE_BYTES * vpn, SEEK_SET);
-            fread(pageData, PAGE_SIZE_BYTES, 1, swapFile);
-            memcpy(physicalMemory[replacedFramePfn].frameData, pageData, PAGE_SIZE_BYTES);
-        }
+    for (int i = 0; i < PAGE_AMOUNT; i++)
+    {
+        swapSlot[i] = -1;
+        slotOwner[i] = -1;
+    }
+    swapSlotAmount = 0;
 
-        // Reference operations
-        if (strcmp(ALGORITHM_NAME, "LRU") == 0)
+    while (fscanf(indexFile, "%hx %d", &vpn, &slot) == 2)
+    {
+        if (vpn >= PAGE_AMOUNT || slot < 0 || slot >= PAGE_AMOUNT || slot >= fileSlotAmount ||
+            swapSlot[vpn] >= 0 || slotOwner[slot] >= 0)
         {
-            moveNodeToTop(&lruListHead, &lruListTail, vpn);
+            fprintf(stderr, "Error: Swap index %s is corrupted.\n", indexFilename);
+            exit(EXIT_FAILURE);
         }
-        // Change R bit to 1
-        innerTable[innerTableVpnIndex] = writeBits(innerTable[innerTableVpnIndex], 1, R_BIT_POSITION, 1);
-
-        // Physical frame number (PFN) extraction
-        pfn = extractBits(innerTable[innerTableVpnIndex], PFN_BIT_SIZE, 0);
-
-        // Instruction
-        if (mode == 'r')
+        swapSlot[vpn] = slot;
+        slotOwner[slot] = vpn;
+        if (slot >= swapSlotAmount)
         {
-            // Read operations
-            // physicalMemory[pfn].frameData[offset];
+            swapSlotAmount = slot + 1;
         }
-        else if (mode == 'w')
-        {
-            // Write operations
-            physicalMemory[pfn].frameData[offset] = (char)value;
+    }
+    if (!feof(indexFile))
+    {
+        fprintf(stderr, "Error: Swap index %s is corrupted.\n", indexFilename);
+        exit(EXIT_FAILURE);
+    }
+    fclose(indexFile);
 
-            // Change M bit to 1
-            innerTable[innerTableVpnIndex] = writeBits(innerTable[innerTableVpnIndex], 1, M_BIT_POSITION, 1);
+    // Holes left by released slots are reused, anything past the last live slot is dropped
+    freeSlotAmount = 0;
+    for (int i = swapSlotAmount - 1; i >= 0; i--)
+    {
+        if (slotOwner[i] < 0)
+        {
+            freeSlots[freeSlotAmount++] = i;
         }
-
-        // Export reference log to output file
-        physicalAddress = writeBits(virtualAddress, VA_VPN_BITS, VA_OFFSET_BITS, pfn);
-        fprintf(outputFile, "0x%04hx 0x%hx 0x%hx 0x%hx 0x%hx 0x%04hx%s\n",
-                virtualAddress, PAGE_OPTION == 1 ? vpn : vpnP1,
-                PAGE_OPTION == 1 ? 0 : vpnP2,
-                offset,
-                pfn,
-                physicalAddress,
-                pageFault == 1 ? " pgfault" : " ");
-
-        // Increase referenceCounter and reset R bits if needed
-        clearReferencedBits();
     }
+    fflush(swapFile);
+    if (ftruncate(fileno(swapFile), (long)PAGE_SIZE_BYTES * swapSlotAmount) != 0)
+    {
+        perror("ftruncate");
+        exit(1);
+    }
+    return 1;
 }
 
-void memoryFlush()
+void writeMetricsHeader()
 {
-    if (PAGE_OPTION == 1)
+    if (METRICS_JSON)
     {
-        unsigned short extractedFrame;
+        return;
+    }
 
+    fprintf(metricsFile, "reference,fault_rate,page_faults,write_backs,resident_frames,dirty_frames,working_set");
+    for (int i = 0; PAGE_OPTION == 2 && i < INNER_TABLE_AMOUNT; i++)
+    {
+        fprintf(metricsFile, ",inner_%d", i);
+    }
+    fprintf(metricsFile, "\n");
+}
+
+void flushMetrics()
+{
+    for (int i = 0; i < metricsRingAmount; i++)
+    {
+        struct metricsSample *sample = &metricsRing[i];
+        double faultRate = (double)sample->windowPageFaults / sample->windowReferences;
+
+        if (METRICS_JSON)
+        {
+            fprintf(metricsFile, "{\"reference\":%ld,\"fault_rate\":%.6f,\"page_faults\":%d,\"write_backs\":%d,"
+                                 "\"resident_frames\":%d,\"dirty_frames\":%d,\"working_set\":%d",
+                    sample->reference, faultRate, sample->windowPageFaults, sample->windowWriteBacks,
+                    sample->residentFrames, sample->dirtyFrames, sample->workingSetSize);
+            for (int j = 0; PAGE_OPTION == 2 && j < INNER_TABLE_AMOUNT; j++)
+            {
+                fprintf(metricsFile, "%s%d", j == 0 ? ",\"inner_residency\":[" : ",", sample->innerTableResidency[j]);
+            }
+            fprintf(metricsFile, "%s}\n", PAGE_OPTION == 2 ? "]" : "");
+        }
+        else
+        {
+            fprintf(metricsFile, "%ld,%.6f,%d,%d,%d,%d,%d", sample->reference, faultRate, sample->windowPageFaults,
+                    sample->windowWriteBacks, sample->residentFrames, sample->dirtyFrames, sample->workingSetSize);
+            for (int j = 0; PAGE_OPTION == 2 && j < INNER_TABLE_AMOUNT; j++)
+            {
+                fprintf(metricsFile, ",%d", sample->innerTableResidency[j]);
+            }
+            fprintf(metricsFile, "\n");
+        }
+    }
+    metricsRingAmount = 0;
+}
+
+// Take one sample covering the references since the previous one
+void sampleMetrics()
+{
+    struct metricsSample *sample = &metricsRing[metricsRingAmount];
+
+    memset(sample, 0, sizeof(struct metricsSample));
+    sample->reference = totalReferenceCounter;
+    sample->windowReferences = totalReferenceCounter - windowReferenceStart;
+    sample->windowPageFaults = totalPageFaultCounter - windowPageFaultStart;
+    sample->windowWriteBacks = writeBackCounter - windowWriteBackStart;
+
+    for (int i = 0; i < PAGE_AMOUNT; i++)
+    {
+        unsigned short entry = 0;
+
+        if (PAGE_OPTION == 1)
+        {
+            entry = singlePageTable[i];
+        }
+        else if (innerTablesTable[i >> (TWO_LEVEL_VPN_P2_BITS)] != NULL)
+        {
+            entry = (innerTablesTable[i >> (TWO_LEVEL_VPN_P2_BITS)])[extractBits(i, TWO_LEVEL_VPN_P2_BITS, 0)];
+        }
+        if (extractBits(entry, 1, V_BIT_POSITION) == 1)
+        {
+            sample->residentFrames++;
+            sample->dirtyFrames += extractBits(entry, 1, M_BIT_POSITION);
+            if (PAGE_OPTION == 2)
+            {
+                sample->innerTableResidency[i >> (TWO_LEVEL_VPN_P2_BITS)]++;
+            }
+        }
+
+        // Working set: pages referenced within the last sampling interval
+        if (lastReferenceTime[i] > totalReferenceCounter - METRICS_INTERVAL)
+        {
+            sample->workingSetSize++;
+        }
+    }
+
+    windowReferenceStart = totalReferenceCounter;
+    windowPageFaultStart = totalPageFaultCounter;
+    windowWriteBackStart = writeBackCounter;
+
+    if (++metricsRingAmount == METRICS_RING_SIZE)
+    {
+        flushMetrics();
+    }
+}
+
+int isLruAlgorithm()
+{
+    return strcmp(ALGORITHM_NAME, "LRU") == 0;
+}
+
+int isHugeRegion(unsigned short vpnP1)
+{
+    return PAGE_OPTION == 2 && extractBits(outerPageTable[vpnP1], 1, H_BIT_POSITION) == 1;
+}
+
+// A huge mapping is one TLB entry for the whole region, base pages have one entry each
+unsigned short tlbKey(unsigned short vpn)
+{
+    unsigned short vpnP1 = extractBits(vpn, TWO_LEVEL_VPN_P1_BITS, TWO_LEVEL_VPN_P2_BITS);
+    return isHugeRegion(vpnP1) ? TLB_HUGE_KEY | vpnP1 : vpn;
+}
+
+int tlbReachBytes()
+{
+    int reach = 0;
+    for (int i = 0; i < tlbEntryAmount; i++)
+    {
+        reach += PAGE_SIZE_BYTES * ((tlbKeys[i] & TLB_HUGE_KEY) ? INNER_TABLE_PAGE_SIZE : 1);
+    }
+    return reach;
+}
+
+void tlbInvalidate(unsigned short key)
+{
+    for (int i = 0; i < tlbEntryAmount; i++)
+    {
+        if (tlbKeys[i] == key)
+        {
+            memmove(&tlbKeys[i], &tlbKeys[i + 1], sizeof(unsigned short) * (tlbEntryAmount - i - 1));
+            tlbEntryAmount--;
+            return;
+        }
+    }
+}
+
+void tlbAccess(unsigned short vpn, long weight)
+{
+    unsigned short key = tlbKey(vpn);
+    int position = 0;
+
+    while (position < tlbEntryAmount && tlbKeys[position] != key)
+    {
+        position++;
+    }
+
+    // A miss fills the entry, evicting the least recently used one when full
+    if (position == tlbEntryAmount)
+    {
+        tlbMissCounter++;
+        if (tlbEntryAmount < TLB_ENTRIES)
+        {
+            tlbEntryAmount++;
+        }
+        position = tlbEntryAmount - 1;
+    }
+    else
+    {
+        tlbHitCounter++;
+    }
+    memmove(&tlbKeys[1], &tlbKeys[0], sizeof(unsigned short) * position);
+    tlbKeys[0] = key;
+
+    // The remaining references of a reduced record hit the entry just used
+    tlbHitCounter += weight - 1;
+    tlbReachSum += (double)tlbReachBytes() * weight;
+}
+
+// Page table entry of vpn, whose inner table is known to exist
+unsigned short *pageTableEntry(unsigned short vpn)
+{
+    if (PAGE_OPTION == 1)
+    {
+        return &singlePageTable[vpn];
+    }
+    return &(innerTablesTable[extractBits(vpn, TWO_LEVEL_VPN_P1_BITS, TWO_LEVEL_VPN_P2_BITS)])[extractBits(vpn, TWO_LEVEL_VPN_P2_BITS, 0)];
+}
+
+// Take a slow frame for vpn, making room by sending the page under the slow tier hand to swap
+int acquireSlowFrame(unsigned short vpn)
+{
+    int slowFrame = -1;
+
+    for (int i = 0; i < SLOW_FRAME_NUMBER && slowFrame < 0; i++)
+    {
+        if (slowFrameOwner[i] < 0)
+        {
+            slowFrame = i;
+        }
+    }
+
+    if (slowFrame < 0)
+    {
+        slowFrame = slowTierHand;
+        slowTierHand = (slowTierHand + 1) % SLOW_FRAME_NUMBER;
+
+        unsigned short ownerVpn = slowFrameOwner[slowFrame];
+        if (extractBits(*pageTableEntry(ownerVpn), 1, M_BIT_POSITION) == 1)
+        {
+            swapWrite(ownerVpn, slowMemory[slowFrame].frameData);
+            writeBackCounter++;
+        }
+        slowTierFrame[ownerVpn] = -1;
+        slowEvictionCounter++;
+        if (TLB_ENTRIES > 0)
+        {
+            tlbInvalidate(ownerVpn);
+        }
+    }
+
+    slowFrameOwner[slowFrame] = vpn;
+    slowTierFrame[vpn] = slowFrame;
+    return slowFrame;
+}
+
+// Move the page leaving fast frame pfn down: to the slow tier when there is one, otherwise to swap if modified
+void evictFastPage(unsigned short vpn, unsigned short pfn)
+{
+    unsigned short *entry = pageTableEntry(vpn);
+
+    if (SLOW_FRAME_NUMBER > 0)
+    {
+        int slowFrame = acquireSlowFrame(vpn);
+        memcpy(slowMemory[slowFrame].frameData, physicalMemory[pfn].frameData, PAGE_SIZE_BYTES);
+
+        // M bit stays to tell whether the swap copy is stale, R bit restarts for the promotion check
+        *entry = writeBits(*entry, 1, R_BIT_POSITION, 0);
+        tierDemotionCounter++;
+    }
+    else if (extractBits(*entry, 1, M_BIT_POSITION) == 1)
+    {
+        swapWrite(vpn, physicalMemory[pfn].frameData);
+        writeBackCounter++;
+    }
+}
+
+// Fill fast frame pfn with vpn from the slow tier if it is held there, otherwise from swap
+int loadPage(unsigned short vpn, unsigned short pfn)
+{
+    int slowFrame = slowTierFrame[vpn];
+
+    if (slowFrame < 0)
+    {
+        swapRead(vpn, physicalMemory[pfn].frameData);
+        return 0;
+    }
+
+    memcpy(physicalMemory[pfn].frameData, slowMemory[slowFrame].frameData, PAGE_SIZE_BYTES);
+    slowFrameOwner[slowFrame] = -1;
+    slowTierFrame[vpn] = -1;
+    return 1;
+}
+
+// Find the page currently mapped to a frame (two-level tables only)
+int findFrameOwner(unsigned short pfn, unsigned short *ownerVpn)
+{
+    for (int i = 0; i < INNER_TABLE_AMOUNT; i++)
+    {
+        if (innerTablesTable[i] == NULL)
+        {
+            continue;
+        }
+        for (int j = 0; j < INNER_TABLE_PAGE_SIZE; j++)
+        {
+            unsigned short entry = (innerTablesTable[i])[j];
+            if (extractBits(entry, 1, V_BIT_POSITION) == 1 && extractBits(entry, PFN_BIT_SIZE, 0) == pfn)
+            {
+                *ownerVpn = (i << (TWO_LEVEL_VPN_P2_BITS)) | j;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+void removeFromReplacementList(unsigned short vpn)
+{
+    if (isLruAlgorithm())
+    {
+        deleteNode(&lruListHead, &lruListTail, vpn);
+    }
+    else
+    {
+        circularDeleteNode(&circularListHead, vpn);
+    }
+}
+
+void addToReplacementList(unsigned short vpn)
+{
+    if (isLruAlgorithm())
+    {
+        insertNode(&lruListHead, &lruListTail, vpn);
+    }
+    else
+    {
+        circularInsertNode(&circularListHead, vpn);
+    }
+}
+
+// Split a huge mapping back into base pages, which stay in the same frames
+void demoteRegion(unsigned short vpnP1)
+{
+    tlbInvalidate(TLB_HUGE_KEY | vpnP1);
+
+    outerPageTable[vpnP1] = writeBits(outerPageTable[vpnP1], 1, H_BIT_POSITION, 0);
+    outerPageTable[vpnP1] = writeBits(outerPageTable[vpnP1], PFN_BIT_SIZE, 0, 0);
+    outerPageTable[vpnP1] = writeBits(outerPageTable[vpnP1], TWO_LEVEL_VPN_P1_BITS, 0, vpnP1);
+    demotionCounter++;
+}
+
+// Map a densely resident region with one outer leaf entry over an aligned block of frames,
+// moving its resident pages into place and loading the missing ones
+void promoteRegion(unsigned short vpnP1)
+{
+    unsigned short *innerTable = innerTablesTable[vpnP1];
+    int blockAmount = initialFrameCounter / INNER_TABLE_PAGE_SIZE;
+    int residentAmount = 0;
+    int bestBlock = -1;
+    int bestBlockScore = -1;
+
+    if (isHugeRegion(vpnP1) || blockAmount == 0)
+    {
+        return;
+    }
+
+    for (int i = 0; i < INNER_TABLE_PAGE_SIZE; i++)
+    {
+        residentAmount += extractBits(innerTable[i], 1, V_BIT_POSITION);
+    }
+    if (residentAmount < HUGE_PAGE_THRESHOLD)
+    {
+        return;
+    }
+
+    // Pick the fully allocated block, not used by another huge page, that already holds most of the region in place
+    for (int block = 0; block < blockAmount; block++)
+    {
+        int blockUsed = 0;
+        int score = 0;
+
+        for (int i = 0; i < INNER_TABLE_AMOUNT; i++)
+        {
+            if (isHugeRegion(i) && extractBits(outerPageTable[i], PFN_BIT_SIZE, 0) == block * INNER_TABLE_PAGE_SIZE)
+            {
+                blockUsed = 1;
+            }
+        }
+        for (int i = 0; i < INNER_TABLE_PAGE_SIZE && !blockUsed; i++)
+        {
+            if (extractBits(innerTable[i], 1, V_BIT_POSITION) == 1 &&
+                extractBits(innerTable[i], PFN_BIT_SIZE, 0) == block * INNER_TABLE_PAGE_SIZE + i)
+            {
+                score++;
+            }
+        }
+        if (!blockUsed && score > bestBlockScore)
+        {
+            bestBlock = block;
+            bestBlockScore = score;
+        }
+    }
+    if (bestBlock < 0)
+    {
+        return;
+    }
+
+    unsigned short blockPfn = bestBlock * INNER_TABLE_PAGE_SIZE;
+
+    // Swap every resident page of the region into its slot, the displaced page takes its old frame
+    for (int i = 0; i < INNER_TABLE_PAGE_SIZE; i++)
+    {
+        unsigned short slotPfn = blockPfn + i;
+        unsigned short pfn = extractBits(innerTable[i], PFN_BIT_SIZE, 0);
+        unsigned short ownerVpn;
+        struct frame tmpFrame;
+
+        if (extractBits(innerTable[i], 1, V_BIT_POSITION) == 0 || pfn == slotPfn)
+        {
+            continue;
+        }
+
+        findFrameOwner(slotPfn, &ownerVpn);
+        unsigned short *ownerInnerTable = innerTablesTable[extractBits(ownerVpn, TWO_LEVEL_VPN_P1_BITS, TWO_LEVEL_VPN_P2_BITS)];
+        unsigned short ownerIndex = extractBits(ownerVpn, TWO_LEVEL_VPN_P2_BITS, 0);
+
+        tmpFrame = physicalMemory[slotPfn];
+        physicalMemory[slotPfn] = physicalMemory[pfn];
+        physicalMemory[pfn] = tmpFrame;
+
+        ownerInnerTable[ownerIndex] = writeBits(ownerInnerTable[ownerIndex], PFN_BIT_SIZE, 0, pfn);
+        innerTable[i] = writeBits(innerTable[i], PFN_BIT_SIZE, 0, slotPfn);
+        tlbInvalidate(ownerVpn);
+    }
+
+    // Load the missing pages of the region over whatever still occupies their slots
+    for (int i = 0; i < INNER_TABLE_PAGE_SIZE; i++)
+    {
+        unsigned short slotPfn = blockPfn + i;
+        unsigned short vpn = (vpnP1 << (TWO_LEVEL_VPN_P2_BITS)) | i;
+        unsigned short ownerVpn;
+
+        if (extractBits(innerTable[i], 1, V_BIT_POSITION) == 1)
+        {
+            continue;
+        }
+
+        findFrameOwner(slotPfn, &ownerVpn);
+        unsigned short *ownerInnerTable = innerTablesTable[extractBits(ownerVpn, TWO_LEVEL_VPN_P1_BITS, TWO_LEVEL_VPN_P2_BITS)];
+        unsigned short ownerIndex = extractBits(ownerVpn, TWO_LEVEL_VPN_P2_BITS, 0);
+
+        evictFastPage(ownerVpn, slotPfn);
+        ownerInnerTable[ownerIndex] = writeBits(ownerInnerTable[ownerIndex], 1, V_BIT_POSITION, 0);
+        removeFromReplacementList(ownerVpn);
+        tlbInvalidate(ownerVpn);
+
+        // A page coming from the slow tier keeps its M bit
+        if (loadPage(vpn, slotPfn) == 0)
+        {
+            innerTable[i] = writeBits(innerTable[i], 1, M_BIT_POSITION, 0);
+        }
+        innerTable[i] = writeBits(innerTable[i], 1, V_BIT_POSITION, 1);
+        innerTable[i] = writeBits(innerTable[i], 1, R_BIT_POSITION, 0);
+        innerTable[i] = writeBits(innerTable[i], PFN_BIT_SIZE, 0, slotPfn);
+        addToReplacementList(vpn);
+        prefetchCounter++;
+    }
+
+    for (int i = 0; i < INNER_TABLE_PAGE_SIZE; i++)
+    {
+        tlbInvalidate((vpnP1 << (TWO_LEVEL_VPN_P2_BITS)) | i);
+    }
+    outerPageTable[vpnP1] = writeBits(outerPageTable[vpnP1], 1, H_BIT_POSITION, 1);
+    outerPageTable[vpnP1] = writeBits(outerPageTable[vpnP1], PFN_BIT_SIZE, 0, blockPfn);
+    promotionCounter++;
+}
+
+void checkpointWrite(FILE *file, const void *data, size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+    if (fwrite(data, size, 1, file) != 1)
+    {
+        perror("fwrite");
+        exit(1);
+    }
+}
+
+void checkpointRead(FILE *file, void *data, size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+    if (fread(data, size, 1, file) != 1)
+    {
+        fprintf(stderr, "Error: Checkpoint file %s is truncated.\n", RESUME_FILENAME);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void saveCheckpoint()
+{
+    char temporaryFilename[FILENAME_MAX_LENGTH + 4];
+    char pageData[PAGE_SIZE_BYTES];
+    char zeroPage[PAGE_SIZE_BYTES];
+    struct checkpointHeader header;
+    struct Node *node;
+
+    memset(&header, 0, sizeof(header));
+    memset(zeroPage, 0, PAGE_SIZE_BYTES);
+
+    // Make the offsets point past everything already produced
+    fflush(outputFile);
+    fflush(swapFile);
+    if (metricsFile != NULL)
+    {
+        flushMetrics();
+        fflush(metricsFile);
+        header.metricsOffset = ftell(metricsFile);
+    }
+
+    memcpy(header.magic, CHECKPOINT_MAGIC, 4);
+    header.version = CHECKPOINT_VERSION;
+    header.pageOption = PAGE_OPTION;
+    header.frameNumber = FRAME_NUMBER;
+    header.tick = TICK;
+    header.hugePageThreshold = HUGE_PAGE_THRESHOLD;
+    header.tlbEntries = TLB_ENTRIES;
+    strcpy(header.algorithmName, ALGORITHM_NAME);
+    header.initialFrameCounter = initialFrameCounter;
+    header.referenceCounter = referenceCounter;
+    header.totalPageFaultCounter = totalPageFaultCounter;
+    header.totalReferenceCounter = totalReferenceCounter;
+    header.traceOffset = ftell(referenceFile);
+    header.outputOffset = ftell(outputFile);
+    header.promotionCounter = promotionCounter;
+    header.demotionCounter = demotionCounter;
+    header.prefetchCounter = prefetchCounter;
+    header.tlbEntryAmount = tlbEntryAmount;
+    header.tlbHitCounter = tlbHitCounter;
+    header.tlbMissCounter = tlbMissCounter;
+    header.tlbReachSum = tlbReachSum;
+    memcpy(header.tlbKeys, tlbKeys, sizeof(tlbKeys));
+
+    // Replacement list length (LRU list is linear, the others are circular)
+    node = isLruAlgorithm() ? lruListHead : circularListHead;
+    if (node != NULL)
+    {
+        do
+        {
+            header.listLength++;
+            node = node->next;
+        } while (node != NULL && node != circularListHead);
+    }
+
+    for (int i = 0; i < INNER_TABLE_AMOUNT; i++)
+    {
+        if (innerTablesTable[i] != NULL)
+        {
+            header.innerTableCount++;
+        }
+    }
+
+    // The sparse store is saved as its raw slots and index instead, to resume with the same layout
+    for (int i = 0; i < PAGE_AMOUNT && !SPARSE_SWAP; i++)
+    {
+        swapRead(i, pageData);
+        if (memcmp(pageData, zeroPage, PAGE_SIZE_BYTES) != 0)
+        {
+            header.swapPageCount++;
+        }
+    }
+    header.sparseSwap = SPARSE_SWAP;
+    header.swapSlotAmount = swapSlotAmount;
+    header.freeSlotAmount = freeSlotAmount;
+    header.zeroFillCounter = zeroFillCounter;
+    header.writeBackCounter = writeBackCounter;
+    header.windowPageFaultStart = windowPageFaultStart;
+    header.windowWriteBackStart = windowWriteBackStart;
+    header.windowReferenceStart = windowReferenceStart;
+    header.slowFrameNumber = SLOW_FRAME_NUMBER;
+    header.slowTierHand = slowTierHand;
+    header.fastAccessCounter = fastAccessCounter;
+    header.slowAccessCounter = slowAccessCounter;
+    header.tierPromotionCounter = tierPromotionCounter;
+    header.tierDemotionCounter = tierDemotionCounter;
+    header.slowEvictionCounter = slowEvictionCounter;
+    header.accessCostSum = accessCostSum;
+
+    // Write to a temporary file first so a crash never leaves a torn checkpoint
+    sprintf(temporaryFilename, "%s.tmp", CHECKPOINT_FILENAME);
+    FILE *checkpointFile = fopen(temporaryFilename, "w");
+    if (checkpointFile == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    checkpointWrite(checkpointFile, &header, sizeof(header));
+    checkpointWrite(checkpointFile, singlePageTable, sizeof(unsigned short) * PAGE_AMOUNT);
+    checkpointWrite(checkpointFile, outerPageTable, sizeof(unsigned short) * INNER_TABLE_AMOUNT);
+
+    for (unsigned short i = 0; i < INNER_TABLE_AMOUNT; i++)
+    {
+        if (innerTablesTable[i] != NULL)
+        {
+            checkpointWrite(checkpointFile, &i, sizeof(i));
+            checkpointWrite(checkpointFile, innerTablesTable[i], sizeof(unsigned short) * INNER_TABLE_PAGE_SIZE);
+        }
+    }
+
+    if (initialFrameCounter > 0)
+    {
+        checkpointWrite(checkpointFile, physicalMemory, PAGE_SIZE_BYTES * initialFrameCounter);
+    }
+    checkpointWrite(checkpointFile, lastReferenceTime, sizeof(lastReferenceTime));
+
+    node = isLruAlgorithm() ? lruListHead : circularListHead;
+    for (int i = 0; i < header.listLength; i++)
+    {
+        checkpointWrite(checkpointFile, &node->data, sizeof(node->data));
+        node = node->next;
+    }
+
+    for (unsigned short i = 0; i < PAGE_AMOUNT && !SPARSE_SWAP; i++)
+    {
+        swapRead(i, pageData);
+        if (memcmp(pageData, zeroPage, PAGE_SIZE_BYTES) != 0)
+        {
+            checkpointWrite(checkpointFile, &i, sizeof(i));
+            checkpointWrite(checkpointFile, pageData, PAGE_SIZE_BYTES);
+        }
+    }
+
+    if (SPARSE_SWAP)
+    {
+        checkpointWrite(checkpointFile, swapSlot, sizeof(swapSlot));
+        checkpointWrite(checkpointFile, freeSlots, sizeof(int) * freeSlotAmount);
+        for (int slot = 0; slot < swapSlotAmount; slot++)
+        {
+            fseek(swapFile, (long)PAGE_SIZE_BYTES * slot, SEEK_SET);
+            if (fread(pageData, PAGE_SIZE_BYTES, 1, swapFile) != 1)
+            {
+                memset(pageData, 0, PAGE_SIZE_BYTES);
+            }
+            checkpointWrite(checkpointFile, pageData, PAGE_SIZE_BYTES);
+        }
+    }
+
+    if (SLOW_FRAME_NUMBER > 0)
+    {
+        checkpointWrite(checkpointFile, slowTierFrame, sizeof(slowTierFrame));
+        checkpointWrite(checkpointFile, slowFrameOwner, sizeof(int) * SLOW_FRAME_NUMBER);
+        checkpointWrite(checkpointFile, slowMemory, PAGE_SIZE_BYTES * SLOW_FRAME_NUMBER);
+    }
+
+    if (fclose(checkpointFile) != 0 || rename(temporaryFilename, CHECKPOINT_FILENAME) != 0)
+    {
+        perror("checkpoint");
+        exit(1);
+    }
+}
+
+void restoreCheckpoint()
+{
+    char pageData[PAGE_SIZE_BYTES];
+    struct checkpointHeader header;
+    unsigned short index;
+
+    FILE *checkpointFile = fopen(RESUME_FILENAME, "r");
+    if (checkpointFile == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    checkpointRead(checkpointFile, &header, sizeof(header));
+    if (memcmp(header.magic, CHECKPOINT_MAGIC, 4) != 0 || header.version != CHECKPOINT_VERSION)
+    {
+        fprintf(stderr, "Error: %s is not a checkpoint file.\n", RESUME_FILENAME);
+        exit(EXIT_FAILURE);
+    }
+    if (header.pageOption != PAGE_OPTION || header.frameNumber != FRAME_NUMBER ||
+        header.tick != TICK || strcmp(header.algorithmName, ALGORITHM_NAME) != 0)
+    {
+        fprintf(stderr, "Error: Checkpoint was taken with -p %d -f %d -a %s -t %d.\n",
+                header.pageOption, header.frameNumber, header.algorithmName, header.tick);
+        exit(EXIT_FAILURE);
+    }
+    if (header.hugePageThreshold != HUGE_PAGE_THRESHOLD || header.tlbEntries != TLB_ENTRIES)
+    {
+        fprintf(stderr, "Error: Checkpoint was taken with --huge-pages %d --tlb-entries %d (0 means off).\n",
+                header.hugePageThreshold, header.tlbEntries);
+        exit(EXIT_FAILURE);
+    }
+
+    initialFrameCounter = header.initialFrameCounter;
+    referenceCounter = header.referenceCounter;
+    totalPageFaultCounter = header.totalPageFaultCounter;
+    totalReferenceCounter = header.totalReferenceCounter;
+    resumeOutputOffset = header.outputOffset;
+    resumeMetricsOffset = header.metricsOffset;
+    writeBackCounter = header.writeBackCounter;
+    windowPageFaultStart = header.windowPageFaultStart;
+    windowWriteBackStart = header.windowWriteBackStart;
+    windowReferenceStart = header.windowReferenceStart;
+    promotionCounter = header.promotionCounter;
+    demotionCounter = header.demotionCounter;
+    prefetchCounter = header.prefetchCounter;
+    tlbEntryAmount = header.tlbEntryAmount;
+    tlbHitCounter = header.tlbHitCounter;
+    tlbMissCounter = header.tlbMissCounter;
+    tlbReachSum = header.tlbReachSum;
+    memcpy(tlbKeys, header.tlbKeys, sizeof(tlbKeys));
+
+    checkpointRead(checkpointFile, singlePageTable, sizeof(unsigned short) * PAGE_AMOUNT);
+    checkpointRead(checkpointFile, outerPageTable, sizeof(unsigned short) * INNER_TABLE_AMOUNT);
+
+    for (int i = 0; i < header.innerTableCount; i++)
+    {
+        checkpointRead(checkpointFile, &index, sizeof(index));
+        if (index >= INNER_TABLE_AMOUNT)
+        {
+            fprintf(stderr, "Error: Checkpoint file %s is corrupted.\n", RESUME_FILENAME);
+            exit(EXIT_FAILURE);
+        }
+        innerTablesTable[index] = (unsigned short *)malloc(sizeof(unsigned short) * INNER_TABLE_PAGE_SIZE);
+        checkpointRead(checkpointFile, innerTablesTable[index], sizeof(unsigned short) * INNER_TABLE_PAGE_SIZE);
+    }
+
+    if (initialFrameCounter > 0)
+    {
+        checkpointRead(checkpointFile, physicalMemory, PAGE_SIZE_BYTES * initialFrameCounter);
+    }
+    checkpointRead(checkpointFile, lastReferenceTime, sizeof(lastReferenceTime));
+
+    // Both insert functions push to the head, so rebuild the list from its tail
+    unsigned short *listData = (unsigned short *)malloc(sizeof(unsigned short) * (header.listLength + 1));
+    for (int i = 0; i < header.listLength; i++)
+    {
+        checkpointRead(checkpointFile, &listData[i], sizeof(unsigned short));
+    }
+    for (int i = header.listLength - 1; i >= 0; i--)
+    {
+        if (isLruAlgorithm())
+        {
+            insertNode(&lruListHead, &lruListTail, listData[i]);
+        }
+        else
+        {
+            circularInsertNode(&circularListHead, listData[i]);
+        }
+    }
+    free(listData);
+
+    // Rewrite the swap store: zeroes everywhere except the saved pages
+    if (header.sparseSwap != SPARSE_SWAP)
+    {
+        fprintf(stderr, "Error: Checkpoint was taken %s --sparse-swap.\n", header.sparseSwap ? "with" : "without");
+        exit(EXIT_FAILURE);
+    }
+    resetSwapStore();
+    if (SPARSE_SWAP)
+    {
+        checkpointRead(checkpointFile, swapSlot, sizeof(swapSlot));
+        checkpointRead(checkpointFile, freeSlots, sizeof(int) * header.freeSlotAmount);
+        freeSlotAmount = header.freeSlotAmount;
+        swapSlotAmount = header.swapSlotAmount;
+        zeroFillCounter = header.zeroFillCounter;
+        for (int slot = 0; slot < swapSlotAmount; slot++)
+        {
+            checkpointRead(checkpointFile, pageData, PAGE_SIZE_BYTES);
+            fseek(swapFile, (long)PAGE_SIZE_BYTES * slot, SEEK_SET);
+            fwrite(pageData, PAGE_SIZE_BYTES, 1, swapFile);
+        }
+    }
+    for (int i = 0; i < header.swapPageCount; i++)
+    {
+        checkpointRead(checkpointFile, &index, sizeof(index));
+        checkpointRead(checkpointFile, pageData, PAGE_SIZE_BYTES);
+        if (index >= PAGE_AMOUNT)
+        {
+            fprintf(stderr, "Error: Checkpoint file %s is corrupted.\n", RESUME_FILENAME);
+            exit(EXIT_FAILURE);
+        }
+        swapWrite(index, pageData);
+    }
+
+    if (header.slowFrameNumber != SLOW_FRAME_NUMBER)
+    {
+        fprintf(stderr, "Error: Checkpoint was taken with %d slow frames.\n", header.slowFrameNumber);
+        exit(EXIT_FAILURE);
+    }
+    if (SLOW_FRAME_NUMBER > 0)
+    {
+        checkpointRead(checkpointFile, slowTierFrame, sizeof(slowTierFrame));
+        checkpointRead(checkpointFile, slowFrameOwner, sizeof(int) * SLOW_FRAME_NUMBER);
+        checkpointRead(checkpointFile, slowMemory, PAGE_SIZE_BYTES * SLOW_FRAME_NUMBER);
+        slowTierHand = header.slowTierHand;
+        fastAccessCounter = header.fastAccessCounter;
+        slowAccessCounter = header.slowAccessCounter;
+        tierPromotionCounter = header.tierPromotionCounter;
+        tierDemotionCounter = header.tierDemotionCounter;
+        slowEvictionCounter = header.slowEvictionCounter;
+        accessCostSum = header.accessCostSum;
+    }
+
+    fclose(checkpointFile);
+
+    // Continue with the first reference after the checkpoint
+    fseek(referenceFile, header.traceOffset, SEEK_SET);
+}
+
+void initializeSimulator()
+{
+    lruListHead = NULL;
+    lruListTail = NULL;
+    circularListHead = NULL;
+
+    initialFrameCounter = 0;
+    referenceCounter = 0;
+    totalPageFaultCounter = 0;
+    totalReferenceCounter = 0;
+    memset(pageFaultCounter, 0, sizeof(pageFaultCounter));
+    promotionCounter = 0;
+    demotionCounter = 0;
+    prefetchCounter = 0;
+    tlbEntryAmount = 0;
+    tlbHitCounter = 0;
+    tlbMissCounter = 0;
+    tlbReachSum = 0;
+    zeroFillCounter = 0;
+    metricsRingAmount = 0;
+    writeBackCounter = 0;
+    windowPageFaultStart = 0;
+    windowWriteBackStart = 0;
+    windowReferenceStart = 0;
+    memset(lastReferenceTime, 0, sizeof(lastReferenceTime));
+    for (int i = 0; i < PAGE_AMOUNT; i++)
+    {
+        swapSlot[i] = -1;
+    }
+    freeSlotAmount = 0;
+    swapSlotAmount = 0;
+
+    slowTierHand = 0;
+    fastAccessCounter = 0;
+    slowAccessCounter = 0;
+    tierPromotionCounter = 0;
+    tierDemotionCounter = 0;
+    slowEvictionCounter = 0;
+    accessCostSum = 0;
+    for (int i = 0; i < PAGE_AMOUNT; i++)
+    {
+        slowTierFrame[i] = -1;
+    }
+    slowMemory = (struct frame *)malloc(PAGE_SIZE_BYTES * SLOW_FRAME_NUMBER);
+    slowFrameOwner = (int *)malloc(sizeof(int) * SLOW_FRAME_NUMBER);
+    for (int i = 0; i < SLOW_FRAME_NUMBER; i++)
+    {
+        slowFrameOwner[i] = -1;
+    }
+
+    physicalMemory = (struct frame *)malloc(PAGE_SIZE_BYTES * FRAME_NUMBER);
+    singlePageTable = (unsigned short *)malloc(sizeof(unsigned short) * PAGE_AMOUNT);
+    outerPageTable = (unsigned short *)malloc(sizeof(unsigned short) * INNER_TABLE_AMOUNT);
+    innerTablesTable = (unsigned short **)malloc(sizeof(unsigned short *) * INNER_TABLE_AMOUNT);
+
+    // Initialize Single Page Table
+    unsigned short zeroMask = 0x0000;
+    for (int i = 0; i < PAGE_AMOUNT; i++)
+    {
+        singlePageTable[i] &= zeroMask;
+    }
+
+    // Initialize Outer Page Table
+    for (int i = 0; i < INNER_TABLE_AMOUNT; i++)
+    {
+        outerPageTable[i] &= zeroMask;
+    }
+
+    // Assign Inner Tables Table to NULL
+    for (int i = 0; i < INNER_TABLE_AMOUNT; i++)
+    {
+        innerTablesTable[i] = NULL;
+    }
+}
+
+void releaseSimulator()
+{
+    for (int i = 0; i < INNER_TABLE_AMOUNT; i++)
+    {
+        if (innerTablesTable[i] != NULL)
+        {
+            free(innerTablesTable[i]);
+        }
+    }
+
+    free(physicalMemory);
+    free(slowMemory);
+    free(slowFrameOwner);
+    free(singlePageTable);
+    free(outerPageTable);
+    free(innerTablesTable);
+
+    // Break the circular list so it can be freed like a linear one
+    if (circularListHead != NULL)
+    {
+        circularListHead->prev->next = NULL;
+    }
+    freeList(circularListHead);
+    freeList(lruListHead);
+}
+
+// Get a frame for vpn: a free one while memory fills up, otherwise the victim of the replacement algorithm
+unsigned short allocateFrame(unsigned short vpn, unsigned short *innerTable)
+{
+    unsigned short victimPageVpn;
+    unsigned short victimPageIndexVpn;
+    unsigned short *victimInnerTable;
+
+    unsigned short replacedFramePfn;
+
+    // CASE 1: Empty frame exists
+    if (initialFrameCounter < FRAME_NUMBER)
+    {
+        // Insert the node to reference string queue depending on the used algorithm
+        if (isLruAlgorithm())
+        {
+            insertNode(&lruListHead, &lruListTail, vpn);
+        }
+        else
+        {
+            circularInsertNode(&circularListHead, vpn);
+        }
+
+        replacedFramePfn = initialFrameCounter;
+        initialFrameCounter++;
+    }
+    // CASE 2: Page replacement
+    else
+    {
+        // Find victim page depending on the replacement algorithm
+        if (strcmp(ALGORITHM_NAME, "FIFO") == 0)
+        {
+            victimPageVpn = algorithmFifo(&circularListHead, vpn);
+        }
+        else if (isLruAlgorithm())
+        {
+            victimPageVpn = algorithmLru(&lruListTail, vpn);
+        }
+        else if (strcmp(ALGORITHM_NAME, "CLOCK") == 0)
+        {
+            victimPageVpn = algorithmClock(&circularListHead, vpn, innerTable);
+        }
+        else if (strcmp(ALGORITHM_NAME, "ECLOCK") == 0)
+        {
+            victimPageVpn = algorithmEclock(&circularListHead, vpn, innerTable);
+        }
+
+        // Victim Table and VPN operations
+        if (PAGE_OPTION == 1)
+        {
+            victimInnerTable = innerTable;
+            victimPageIndexVpn = victimPageVpn;
+        }
+        else if (PAGE_OPTION == 2)
+        {
+            unsigned short victimPageVpnP1 = extractBits(victimPageVpn, TWO_LEVEL_VPN_P1_BITS, TWO_LEVEL_VPN_P2_BITS);
+            unsigned short victimPageVpnP2 = extractBits(victimPageVpn, TWO_LEVEL_VPN_P2_BITS, 0);
+
+            victimInnerTable = innerTablesTable[victimPageVpnP1];
+            victimPageIndexVpn = victimPageVpnP2;
+
+            // Memory pressure on a huge page splits it before one of its pages is evicted
+            if (isHugeRegion(victimPageVpnP1))
+            {
+                demoteRegion(victimPageVpnP1);
+            }
+        }
+
+        lastVictimVpn = victimPageVpn;
+
+        // Extract PFN of victim page
+        replacedFramePfn = extractBits(victimInnerTable[victimPageIndexVpn], PFN_BIT_SIZE, 0);
+
+        // Demote the victim page to the slow tier, or save it to swapfile if it is modified
+        evictFastPage(victimPageVpn, replacedFramePfn);
+
+        // Change V bit to 0 for victim page
+        victimInnerTable[victimPageIndexVpn] = writeBits(victimInnerTable[victimPageIndexVpn], 1, V_BIT_POSITION, 0);
+        if (TLB_ENTRIES > 0)
+        {
+            tlbInvalidate(victimPageVpn);
+        }
+    }
+
+    return replacedFramePfn;
+}
+
+// Move the slow pages referenced since the last tick back to the fast tier
+void promoteHotPages()
+{
+    char pageData[PAGE_SIZE_BYTES];
+
+    for (int i = 0; i < SLOW_FRAME_NUMBER; i++)
+    {
+        int vpn = slowFrameOwner[i];
+        if (vpn < 0 || extractBits(*pageTableEntry(vpn), 1, R_BIT_POSITION) == 0)
+        {
+            continue;
+        }
+
+        unsigned short *innerTable = PAGE_OPTION == 1 ? singlePageTable : innerTablesTable[extractBits(vpn, TWO_LEVEL_VPN_P1_BITS, TWO_LEVEL_VPN_P2_BITS)];
+        unsigned short *entry = pageTableEntry(vpn);
+
+        // Free the slow frame first so the fast victim can take it
+        memcpy(pageData, slowMemory[i].frameData, PAGE_SIZE_BYTES);
+        slowFrameOwner[i] = -1;
+        slowTierFrame[vpn] = -1;
+
+        unsigned short pfn = allocateFrame(vpn, innerTable);
+        memcpy(physicalMemory[pfn].frameData, pageData, PAGE_SIZE_BYTES);
+        *entry = writeBits(*entry, 1, V_BIT_POSITION, 1);
+        *entry = writeBits(*entry, PFN_BIT_SIZE, 0, pfn);
+
+        if (isLruAlgorithm())
+        {
+            moveNodeToTop(&lruListHead, &lruListTail, vpn);
+        }
+        if (TLB_ENTRIES > 0)
+        {
+            tlbInvalidate(vpn);
+        }
+        tierPromotionCounter++;
+    }
+}
+
+void clearReferencedBits()
+{
+    referenceCounter++;
+    if (referenceCounter == TICK)
+    {
+        // Slow pages referenced since the last tick are hot enough to move up
+        if (SLOW_FRAME_NUMBER > 0)
+        {
+            promoteHotPages();
+        }
+
+        if (PAGE_OPTION == 1)
+        {
+            for (int i = 0; i < PAGE_AMOUNT; i++)
+            {
+                singlePageTable[i] = writeBits(singlePageTable[i], 1, R_BIT_POSITION, 0);
+            }
+        }
+        else if (PAGE_OPTION == 2)
+        {
+            for (int i = 0; i < INNER_TABLE_AMOUNT; i++)
+            {
+                if (innerTablesTable[i] != NULL)
+                {
+                    for (int j = 0; j < INNER_TABLE_PAGE_SIZE; j++)
+                    {
+                        (innerTablesTable[i])[j] = writeBits((innerTablesTable[i])[j], 1, R_BIT_POSITION, 0);
+                    }
+                }
+            }
+        }
+        referenceCounter = 0;
+    }
+}
+
+// Print the state a differential engine reached at the record it just reported
+void dumpDifferentialState(struct differentialRecord *record)
+{
+    int frameAmount = 0;
+
+    printf("  %s engine state:\n", differentialEngineName);
+
+    // Frame table, rebuilt from the valid page table entries and the slow tier
+    printf("    frames:");
+    for (int i = 0; i < PAGE_AMOUNT; i++)
+    {
+        unsigned short entry = 0;
+
+        if (PAGE_OPTION == 1)
+        {
+            entry = singlePageTable[i];
+        }
+        else if (innerTablesTable[i >> (TWO_LEVEL_VPN_P2_BITS)] != NULL)
+        {
+            entry = *pageTableEntry(i);
+        }
+        if (extractBits(entry, 1, V_BIT_POSITION) == 1)
+        {
+            printf("%s 0x%hx=vpn 0x%x", frameAmount++ % 8 == 0 ? "\n     " : "", extractBits(entry, PFN_BIT_SIZE, 0), i);
+        }
+    }
+    for (int i = 0; i < SLOW_FRAME_NUMBER; i++)
+    {
+        if (slowFrameOwner[i] >= 0)
+        {
+            printf("%s 0x%x=vpn 0x%x", frameAmount++ % 8 == 0 ? "\n     " : "", FRAME_NUMBER + i, slowFrameOwner[i]);
+        }
+    }
+    printf("\n");
+
+    if (record->pageFault >= 0)
+    {
+        unsigned short vpn = extractBits(record->virtualAddress, VA_VPN_BITS, VA_OFFSET_BITS);
+        unsigned short entry = *pageTableEntry(vpn);
+
+        printf("    pte of vpn 0x%hx: 0x%04hx (V %d R %d M %d H %d pfn 0x%hx)\n", vpn, entry,
+               extractBits(entry, 1, V_BIT_POSITION), extractBits(entry, 1, R_BIT_POSITION),
+               extractBits(entry, 1, M_BIT_POSITION),
+               PAGE_OPTION == 2 ? extractBits(outerPageTable[extractBits(vpn, TWO_LEVEL_VPN_P1_BITS, TWO_LEVEL_VPN_P2_BITS)], 1, H_BIT_POSITION) : 0,
+               extractBits(entry, PFN_BIT_SIZE, 0));
+    }
+
+    // Replacement list: most recent page at the head, next candidate at the tail (the hand of the circular list)
+    if (isLruAlgorithm() && lruListHead != NULL)
+    {
+        printf("    lru list head vpn 0x%hx tail vpn 0x%hx\n", lruListHead->data, lruListTail->data);
+    }
+    else if (!isLruAlgorithm() && circularListHead != NULL)
+    {
+        printf("    circular list head vpn 0x%hx hand vpn 0x%hx\n", circularListHead->data, circularListHead->prev->data);
+    }
+    fflush(stdout);
+}
+
+// Send one record to the checker and wait until it tells the engine to go on or to dump its state
+void reportDifferentialRecord(struct differentialRecord *record)
+{
+    char command;
+
+    fwrite(record, sizeof(*record), 1, differentialPipe);
+    fflush(differentialPipe);
+    if (read(differentialControl, &command, 1) != 1)
+    {
+        exit(EXIT_FAILURE);
+    }
+    if (command == 'd')
+    {
+        dumpDifferentialState(record);
+        exit(EXIT_SUCCESS);
+    }
+}
+
+void processMemoryReferences()
+{
+    char memoryReference[WEIGHTED_REF_MAX_SIZE];
+    char mode;
+    unsigned short value;
+    unsigned short virtualAddress;
+    long weight;
+
+    unsigned short vpn;
+    unsigned short vpnP1;
+    unsigned short vpnP2;
+    unsigned short offset;
+
+    unsigned short physicalAddress;
+
+    int pageFault;
+    int slowFrame;
+
+    while (fgets(memoryReference, WEIGHTED_TRACE ? WEIGHTED_REF_MAX_SIZE : MEM_REF_MAX_SIZE, referenceFile) != NULL)
+    {
+        // Initially no page fault is assumes
+        pageFault = 0;
+        lastVictimVpn = -1;
+
+        // Remove newline character from memory reference
+        memoryReference[strcspn(memoryReference, "\n")] = 0;
+
+        // Extract virtual address, mode and value (and weight of a reduced trace record) from memory reference
+        weight = 1;
+        if (WEIGHTED_TRACE)
+        {
+            if (sscanf(memoryReference, "%c %hx %hx %ld", &mode, &virtualAddress, &value, &weight) != 4 || weight < 1)
+            {
+                fprintf(stderr, "Error: Malformed reduced trace record \"%s\".\n", memoryReference);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else
+        {
+            virtualAddress = referenceExtraction(memoryReference, &mode, &value);
+        }
+
+        // Extract virtual page number (VPN) and offset
+        vpn = extractBits(virtualAddress, VA_VPN_BITS, VA_OFFSET_BITS);
+        vpnP1 = extractBits(virtualAddress, TWO_LEVEL_VPN_P1_BITS, VA_OFFSET_BITS + TWO_LEVEL_VPN_P2_BITS);
+        vpnP2 = extractBits(virtualAddress, TWO_LEVEL_VPN_P2_BITS, VA_OFFSET_BITS);
+        offset = extractBits(virtualAddress, VA_OFFSET_BITS, 0);
+
+        unsigned short *innerTable;
+        unsigned short vBit;
+        unsigned short pfn;
+        unsigned short innerTableVpnIndex;
+
+        // Assign the page table and validation bit
+        if (PAGE_OPTION == 1)
+        {
+            innerTable = singlePageTable;
+            vBit = extractBits(singlePageTable[vpn], 1, V_BIT_POSITION);
+            innerTableVpnIndex = vpn;
+        }
+        else if (PAGE_OPTION == 2)
+        {
+            unsigned short vBitP1 = extractBits(outerPageTable[vpnP1], 1, V_BIT_POSITION);
+
+            // Create inner table if not exists
+            if (vBitP1 == 0 && innerTablesTable[vpnP1] == NULL)
+            {
+                innerTablesTable[vpnP1] = (unsigned short *)malloc(sizeof(unsigned short) * INNER_TABLE_PAGE_SIZE);
+
+                // Initialize inner table with all zeroes
+                unsigned short zeroMask = 0x0000;
+                for (int i = 0; i < INNER_TABLE_PAGE_SIZE; i++)
+                {
+                    (innerTablesTable[vpnP1])[i] &= zeroMask;
+                }
+
+                outerPageTable[vpnP1] = writeBits(outerPageTable[vpnP1], 1, V_BIT_POSITION, 1);
+                outerPageTable[vpnP1] = writeBits(outerPageTable[vpnP1], TWO_LEVEL_VPN_P1_BITS, 0, vpnP1);
+            }
+
+            innerTable = innerTablesTable[vpnP1];
+            vBit = extractBits(innerTable[vpnP2], 1, V_BIT_POSITION);
+            innerTableVpnIndex = vpnP2;
+        }
+
+        // Page fault, unless the page is held in the slow tier
+        slowFrame = slowTierFrame[vpn];
+        if (vBit == 0 && slowFrame < 0)
+        {
+            unsigned short replacedFramePfn;
+            char pageData[PAGE_SIZE_BYTES];
+
+            // Mark page fault
+            pageFault = 1;
+            totalPageFaultCounter++;
+            pageFaultCounter[vpn]++;
+
+            replacedFramePfn = allocateFrame(vpn, innerTable);
+
+            // Page Fault Operations
+            innerTable[innerTableVpnIndex] = writeBits(innerTable[innerTableVpnIndex], 1, V_BIT_POSITION, 1);
+            innerTable[innerTableVpnIndex] = writeBits(innerTable[innerTableVpnIndex], 1, M_BIT_POSITION, 0);
+            innerTable[innerTableVpnIndex] = writeBits(innerTable[innerTableVpnIndex], 1, R_BIT_POSITION, 1);
+            innerTable[innerTableVpnIndex] = writeBits(innerTable[innerTableVpnIndex], PFN_BIT_SIZE, 0, replacedFramePfn);
+
+            // Read the desired page data from swapfile and overwrite on the victim page's frame
+            swapRead(vpn, pageData);
+            memcpy(physicalMemory[replacedFramePfn].frameData, pageData, PAGE_SIZE_BYTES);
+        }
+
+        // Reference operations (a slow page is not in the replacement list)
+        if (isLruAlgorithm() && slowFrame < 0)
+        {
+            moveNodeToTop(&lruListHead, &lruListTail, vpn);
+        }
+        // Change R bit to 1
+        innerTable[innerTableVpnIndex] = writeBits(innerTable[innerTableVpnIndex], 1, R_BIT_POSITION, 1);
+
+        // Physical frame number (PFN) extraction, a huge page is translated by its outer leaf entry
+        // and slow frames are numbered after the fast ones
+        if (slowFrame >= 0)
+        {
+            pfn = FRAME_NUMBER + slowFrame;
+        }
+        else if (isHugeRegion(vpnP1))
+        {
+            pfn = extractBits(outerPageTable[vpnP1], PFN_BIT_SIZE, 0) + vpnP2;
+        }
+        else
+        {
+            pfn = extractBits(innerTable[innerTableVpnIndex], PFN_BIT_SIZE, 0);
+        }
+
+        if (TLB_ENTRIES > 0)
+        {
+            tlbAccess(vpn, weight);
+        }
+
+        // Estimated access cost of the tier the page is served from
+        if (slowFrame >= 0)
+        {
+            slowAccessCounter += weight;
+            accessCostSum += SLOW_ACCESS_COST * weight;
+        }
+        else
+        {
+            fastAccessCounter += weight;
+            accessCostSum += FAST_ACCESS_COST * weight + (pageFault ? FAULT_ACCESS_COST : 0);
+        }
+
+        // Instruction
+        if (mode == 'r')
+        {
+            // Read operations
+            // physicalMemory[pfn].frameData[offset];
+        }
+        else if (mode == 'w')
+        {
+            // Write operations
+            if (slowFrame >= 0)
+            {
+                slowMemory[slowFrame].frameData[offset] = (char)value;
+            }
+            else
+            {
+                physicalMemory[pfn].frameData[offset] = (char)value;
+            }
+
+            // The first write after a swap-in makes the swapped copy stale
+            if (extractBits(innerTable[innerTableVpnIndex], 1, M_BIT_POSITION) == 0)
+            {
+                swapRelease(vpn);
+            }
+
+            // Change M bit to 1
+            innerTable[innerTableVpnIndex] = writeBits(innerTable[innerTableVpnIndex], 1, M_BIT_POSITION, 1);
+        }
+
+        // Export reference log to output file
+        physicalAddress = writeBits(virtualAddress, VA_VPN_BITS, VA_OFFSET_BITS, pfn);
+        fprintf(outputFile, "0x%04hx 0x%hx 0x%hx 0x%hx 0x%hx 0x%04hx%s\n",
+                virtualAddress, PAGE_OPTION == 1 ? vpn : vpnP1,
+                PAGE_OPTION == 1 ? 0 : vpnP2,
+                offset,
+                pfn,
+                physicalAddress,
+                pageFault == 1 ? " pgfault" : " ");
+
+        // Differential mode streams every reference to the checker
+        if (differentialPipe != NULL)
+        {
+            struct differentialRecord record = {virtualAddress, pfn, pageFault, lastVictimVpn};
+            reportDifferentialRecord(&record);
+        }
+
+        // A fault may have made the region dense enough for a huge page
+        if (HUGE_PAGE_THRESHOLD > 0 && pageFault == 1)
+        {
+            promoteRegion(vpnP1);
+
+            // Prefetched pages were pushed above this one, the next reference of a reduced record moves it back
+            if (weight > 1 && isLruAlgorithm())
+            {
+                moveNodeToTop(&lruListHead, &lruListTail, vpn);
+            }
+        }
+
+        // Increase referenceCounter and reset R bits if needed
+        clearReferencedBits();
+
+        // The rest of a reduced record are hits on the same page: only R bit and tick effects remain
+        for (long i = 1; i < weight; i++)
+        {
+            innerTable[innerTableVpnIndex] = writeBits(innerTable[innerTableVpnIndex], 1, R_BIT_POSITION, 1);
+            clearReferencedBits();
+        }
+
+        // Periodically save the whole simulator state
+        totalReferenceCounter += weight;
+        lastReferenceTime[vpn] = totalReferenceCounter;
+        if (METRICS_INTERVAL > 0 && totalReferenceCounter / METRICS_INTERVAL != (totalReferenceCounter - weight) / METRICS_INTERVAL)
+        {
+            sampleMetrics();
+        }
+        if (CHECKPOINT_INTERVAL > 0 && totalReferenceCounter / CHECKPOINT_INTERVAL != (totalReferenceCounter - weight) / CHECKPOINT_INTERVAL)
+        {
+            saveCheckpoint();
+
+            // The differential mode continues from the checkpoint just taken, exactly as a resumed run would
+            if (differentialPipe != NULL)
+            {
+                releaseSimulator();
+                initializeSimulator();
+                restoreCheckpoint();
+            }
+        }
+    }
+}
+
+void memoryFlush()
+{
+    if (PAGE_OPTION == 1)
+    {
+        unsigned short extractedFrame;
+
+        for (int i = 0; i < PAGE_AMOUNT; i++)
+        {
+            if (extractBits(singlePageTable[i], 1, V_BIT_POSITION) == 1)
+            {
+                extractedFrame = extractBits(singlePageTable[i], PFN_BIT_SIZE, 0);
+
+                swapWrite(i, physicalMemory[extractedFrame].frameData);
+            }
+        }
+    }
+    else if (PAGE_OPTION == 2)
+    {
+        unsigned short tmpVirtualAddress = 0x0000;
+        unsigned short extractedVpn;
+        unsigned short extractedFrame;
+        for (int i = 0; i < INNER_TABLE_AMOUNT; i++)
+        {
+            if (extractBits(outerPageTable[i], 1, V_BIT_POSITION) == 1)
+            {
+                // Write VPN_P1
+                tmpVirtualAddress = writeBits(tmpVirtualAddress, TWO_LEVEL_VPN_P1_BITS, TWO_LEVEL_VPN_P2_BITS + VA_OFFSET_BITS, i);
+                for (int j = 0; j < INNER_TABLE_PAGE_SIZE; j++)
+                {
+                    if (innerTablesTable[i] != NULL)
+                    {
+                        // Write VPN_P2
+                        tmpVirtualAddress = writeBits(tmpVirtualAddress, TWO_LEVEL_VPN_P2_BITS, VA_OFFSET_BITS, j);
+                        if (extractBits((innerTablesTable[i])[j], 1, V_BIT_POSITION) == 1)
+                        {
+                            extractedVpn = extractBits(tmpVirtualAddress, VA_VPN_BITS, VA_OFFSET_BITS);
+                            extractedFrame = extractBits((innerTablesTable[i])[j], PFN_BIT_SIZE, 0);
+
+                            swapWrite(extractedVpn, physicalMemory[extractedFrame].frameData);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Pages held in the slow tier are flushed as well
+    for (int i = 0; i < SLOW_FRAME_NUMBER; i++)
+    {
+        if (slowFrameOwner[i] >= 0)
+        {
+            swapWrite(slowFrameOwner[i], slowMemory[i].frameData);
+        }
+    }
+}
+
+unsigned short recordVpn(struct weightedReference *record)
+{
+    return extractBits(record->virtualAddress, VA_VPN_BITS, VA_OFFSET_BITS);
+}
+
+// Fold a later record of the same page into an earlier one, keeping its write
+void mergeRecords(struct weightedReference *into, struct weightedReference *from)
+{
+    into->weight += from->weight;
+    if (from->mode == 'w')
+    {
+        into->mode = 'w';
+        into->virtualAddress = from->virtualAddress;
+        into->value = from->value;
+    }
+}
+
+void reduceTrace()
+{
+    char memoryReference[MEM_REF_MAX_SIZE];
+    struct weightedReference reference;
+    long referenceAmount = 0;
+    int recordAmount = 0;
+    int recordCapacity = 1024;
+    struct weightedReference *records = (struct weightedReference *)malloc(sizeof(struct weightedReference) * recordCapacity);
+
+    FILE *inputFile = fopen(REFERENCE_FILENAME, "r");
+    if (inputFile == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    // Collapse runs of references to the same page into one weighted record
+    while (fgets(memoryReference, MEM_REF_MAX_SIZE, inputFile) != NULL)
+    {
+        memoryReference[strcspn(memoryReference, "\n")] = 0;
+
+        reference.value = 0;
+        reference.weight = 1;
+        reference.virtualAddress = referenceExtraction(memoryReference, &reference.mode, &reference.value);
+        referenceAmount++;
+
+        if (recordAmount > 0 && recordVpn(&records[recordAmount - 1]) == recordVpn(&reference))
+        {
+            mergeRecords(&records[recordAmount - 1], &reference);
+            continue;
+        }
+
+        if (recordAmount == recordCapacity)
+        {
+            recordCapacity *= 2;
+            records = (struct weightedReference *)realloc(records, sizeof(struct weightedReference) * recordCapacity);
+        }
+        records[recordAmount++] = reference;
+    }
+    fclose(inputFile);
+
+    // Drop a record whose page stays among the last REDUCE_FRAMES distinct pages from its previous kept
+    // reference to its next reference: LRU with at least that many frames hits on it, and on every other
+    // page, either way, so the fault count is exact. Its weight and write move to the previous kept record.
+    int *kept = (int *)malloc(sizeof(int) * (recordAmount + 1));
+    for (int i = 0; i < recordAmount; i++)
+    {
+        kept[i] = 1;
+    }
+
+    if (REDUCE_FRAMES > 0)
+    {
+        int *nextReference = (int *)malloc(sizeof(int) * (recordAmount + 1));
+        int lastReference[PAGE_AMOUNT];
+        int lastKept[PAGE_AMOUNT];
+        int seenStamp[PAGE_AMOUNT];
+
+        for (int i = 0; i < PAGE_AMOUNT; i++)
+        {
+            lastReference[i] = -1;
+            lastKept[i] = -1;
+            seenStamp[i] = -1;
+        }
+        for (int i = recordAmount - 1; i >= 0; i--)
+        {
+            nextReference[i] = lastReference[recordVpn(&records[i])];
+            lastReference[recordVpn(&records[i])] = i;
+        }
+
+        for (int i = 0; i < recordAmount; i++)
+        {
+            unsigned short vpn = recordVpn(&records[i]);
+            int previous = lastKept[vpn];
+            int distinctPages = 0;
+
+            if (previous >= 0 && nextReference[i] >= 0)
+            {
+                for (int j = previous; j <= nextReference[i] && distinctPages <= REDUCE_FRAMES; j++)
+                {
+                    unsigned short windowVpn = recordVpn(&records[j]);
+                    if (kept[j] && seenStamp[windowVpn] != i)
+                    {
+                        seenStamp[windowVpn] = i;
+                        distinctPages++;
+                    }
+                }
+
+                if (distinctPages <= REDUCE_FRAMES)
+                {
+                    kept[i] = 0;
+                    mergeRecords(&records[previous], &records[i]);
+                    continue;
+                }
+            }
+            lastKept[vpn] = i;
+        }
+        free(nextReference);
+    }
+
+    FILE *reducedFile = fopen(REDUCED_FILENAME, "w");
+    if (reducedFile == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    // Dropped records may leave runs of the same page behind, collapse those again while writing
+    int writtenAmount = 0;
+    int pending = -1;
+    fprintf(reducedFile, "%s %d\n", REDUCED_TRACE_HEADER, REDUCE_FRAMES);
+    for (int i = 0; i <= recordAmount; i++)
+    {
+        if (i < recordAmount && !kept[i])
+        {
+            continue;
+        }
+        if (i < recordAmount && pending >= 0 && recordVpn(&records[pending]) == recordVpn(&records[i]))
+        {
+            mergeRecords(&records[pending], &records[i]);
+            continue;
+        }
+        if (pending >= 0)
+        {
+            fprintf(reducedFile, "%c 0x%04hx 0x%hx %ld\n", records[pending].mode, records[pending].virtualAddress,
+                    records[pending].value, records[pending].weight);
+            writtenAmount++;
+        }
+        pending = i;
+    }
+    fclose(reducedFile);
+
+    printf("Reduced %ld references to %d records\n", referenceAmount, writtenAmount);
+
+    free(kept);
+    free(records);
+}
+
+// Read the header of a reduced trace and check the frame bound its filter relies on
+void readReducedTraceHeader()
+{
+    char header[WEIGHTED_REF_MAX_SIZE];
+    char headerName[WEIGHTED_REF_MAX_SIZE];
+    int filterFrames;
+
+    if (fgets(header, WEIGHTED_REF_MAX_SIZE, referenceFile) == NULL ||
+        sscanf(header, "%s %d", headerName, &filterFrames) != 2 || strcmp(headerName, REDUCED_TRACE_HEADER) != 0)
+    {
+        fprintf(stderr, "Error: %s is not a reduced trace.\n", REFERENCE_FILENAME);
+        exit(EXIT_FAILURE);
+    }
+
+    // Huge page prefetch and forced demotion break the LRU stack property the filter relies on
+    if (filterFrames > 0 && (strcmp(ALGORITHM_NAME, "LRU") != 0 || FRAME_NUMBER < filterFrames || HUGE_PAGE_THRESHOLD > 0))
+    {
+        fprintf(stderr, "Error: Reduced trace is only exact for LRU with at least %d frames and no huge pages.\n", filterFrames);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Spatial hash sampling: a page is either always or never simulated
+int isSampledVpn(unsigned short vpn)
+{
+    unsigned int hash = ((unsigned int)vpn * SAMPLE_HASH_MULTIPLIER) >> (32 - SAMPLE_HASH_BITS);
+    return hash < (unsigned int)(SAMPLE_RATE * (1 << SAMPLE_HASH_BITS));
+}
+
+// Write the references of sampled pages as a reduced trace, collapsing runs of the same page
+void writeSampledTrace(FILE *sampledFile, long *totalReferences, long *sampledReferences)
+{
+    char memoryReference[WEIGHTED_REF_MAX_SIZE];
+    char headerName[WEIGHTED_REF_MAX_SIZE];
+    struct weightedReference reference;
+    struct weightedReference pending;
+    int filterFrames;
+
+    FILE *inputFile = fopen(REFERENCE_FILENAME, "r");
+    if (inputFile == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    if (WEIGHTED_TRACE)
+    {
+        if (fgets(memoryReference, WEIGHTED_REF_MAX_SIZE, inputFile) == NULL ||
+            sscanf(memoryReference, "%s %d", headerName, &filterFrames) != 2 || strcmp(headerName, REDUCED_TRACE_HEADER) != 0)
+        {
+            fprintf(stderr, "Error: %s is not a reduced trace.\n", REFERENCE_FILENAME);
+            exit(EXIT_FAILURE);
+        }
+        if (filterFrames > 0)
+        {
+            fprintf(stderr, "Error: Sampling needs a reduced trace made without --reduce-frames.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    *totalReferences = 0;
+    *sampledReferences = 0;
+    pending.weight = 0;
+    fprintf(sampledFile, "%s 0\n", REDUCED_TRACE_HEADER);
+
+    while (fgets(memoryReference, WEIGHTED_TRACE ? WEIGHTED_REF_MAX_SIZE : MEM_REF_MAX_SIZE, inputFile) != NULL)
+    {
+        memoryReference[strcspn(memoryReference, "\n")] = 0;
+
+        reference.value = 0;
+        reference.weight = 1;
+        if (WEIGHTED_TRACE)
+        {
+            sscanf(memoryReference, "%c %hx %hx %ld", &reference.mode, &reference.virtualAddress, &reference.value, &reference.weight);
+        }
+        else
+        {
+            reference.virtualAddress = referenceExtraction(memoryReference, &reference.mode, &reference.value);
+        }
+        *totalReferences += reference.weight;
+
+        if (!isSampledVpn(recordVpn(&reference)))
+        {
+            continue;
+        }
+        *sampledReferences += reference.weight;
+
+        if (pending.weight > 0 && recordVpn(&pending) == recordVpn(&reference))
+        {
+            mergeRecords(&pending, &reference);
+            continue;
+        }
+        if (pending.weight > 0)
+        {
+            fprintf(sampledFile, "%c 0x%04hx 0x%hx %ld\n", pending.mode, pending.virtualAddress, pending.value, pending.weight);
+        }
+        pending = reference;
+    }
+    if (pending.weight > 0)
+    {
+        fprintf(sampledFile, "%c 0x%04hx 0x%hx %ld\n", pending.mode, pending.virtualAddress, pending.value, pending.weight);
+    }
+
+    fclose(inputFile);
+}
+
+// Simulate one configuration over an already opened trace with a scratch swap file and log
+int simulateConfiguration(FILE *trace, int weighted, const char *algorithm, int frames, int tick)
+{
+    FILE *scratchSwapFile = tmpfile();
+    FILE *scratchOutputFile = tmpfile();
+    if (scratchSwapFile == NULL || scratchOutputFile == NULL)
+    {
+        perror("tmpfile");
+        exit(1);
+    }
+    strcpy(ALGORITHM_NAME, algorithm);
+    FRAME_NUMBER = frames;
+    PFN_BIT_SIZE = (int)ceil(log2((double)FRAME_NUMBER));
+    TICK = tick;
+    WEIGHTED_TRACE = weighted;
+
+    swapFile = scratchSwapFile;
+    outputFile = scratchOutputFile;
+    referenceFile = trace;
+    rewind(referenceFile);
+
+    initializeSimulator();
+    resetSwapStore();
+    if (WEIGHTED_TRACE)
+    {
+        readReducedTraceHeader();
+    }
+    processMemoryReferences();
+
+    fclose(scratchSwapFile);
+    fclose(scratchOutputFile);
+
+    return totalPageFaultCounter;
+}
+
+// Estimate fault counts of every policy and frame count from the sampled pages only
+void sampledMissRatioCurves()
+{
+    const char *algorithms[] = {"FIFO", "LRU", "CLOCK", "ECLOCK"};
+    int algorithmAmount = sizeof(algorithms) / sizeof(algorithms[0]);
+    int originalWeighted = WEIGHTED_TRACE;
+    char selectedAlgorithm[ALGO_NAME_MAX_SIZE + 1];
+    long totalReferences;
+    long sampledReferences;
+    int outsideBoundAmount = 0;
+    double maximumError = 0;
+
+    strcpy(selectedAlgorithm, ALGORITHM_NAME);
+    CHECKPOINT_INTERVAL = 0;
+    METRICS_INTERVAL = 0;
+
+    FILE *sampledFile = tmpfile();
+    FILE *exactFile = SAMPLE_VERIFY ? fopen(REFERENCE_FILENAME, "r") : NULL;
+    FILE *mrcFile = fopen(MRC_FILENAME, "w");
+    if (sampledFile == NULL || mrcFile == NULL || (SAMPLE_VERIFY && exactFile == NULL))
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    writeSampledTrace(sampledFile, &totalReferences, &sampledReferences);
+    if (sampledReferences == 0)
+    {
+        fprintf(stderr, "Error: No page of the trace was sampled, increase the sample rate.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // SHARDS-style scaling by the sampled share of references rather than the nominal rate
+    double scale = (double)totalReferences / sampledReferences;
+    int sampledTick = TICK == 0 ? 0 : (int)fmax(1, round(TICK * SAMPLE_RATE));
+
+    fprintf(mrcFile, "algorithm,frames,sampled_frames,estimated_faults,miss_ratio,error_bound%s\n",
+            SAMPLE_VERIFY ? ",exact_faults,exact_miss_ratio,within_bound" : "");
+
+    for (int a = 0; a < algorithmAmount; a++)
+    {
+        if (strcmp(selectedAlgorithm, "") != 0 && strcmp(selectedAlgorithm, algorithms[a]) != 0)
+        {
+            continue;
+        }
+
+        for (int frames = MRC_MIN_FRAMES; frames <= MRC_MAX_FRAMES; frames += MRC_FRAME_STEP)
+        {
+            int sampledFrames = (int)fmax(1, round(frames * SAMPLE_RATE));
+            int sampledFaults = simulateConfiguration(sampledFile, 1, algorithms[a], sampledFrames, sampledTick);
+
+            // Variance of the sampled sum over pages under independent page sampling
+            double variance = 0;
+            for (int i = 0; i < PAGE_AMOUNT; i++)
+            {
+                variance += (double)pageFaultCounter[i] * pageFaultCounter[i];
+            }
+            variance *= 1 - SAMPLE_RATE;
+            releaseSimulator();
+
+            double estimatedFaults = sampledFaults * scale;
+            double errorBound = MRC_CONFIDENCE_Z * sqrt(variance) * scale;
+            fprintf(mrcFile, "%s,%d,%d,%.0f,%.6f,%.0f", algorithms[a], frames, sampledFrames, estimatedFaults,
+                    estimatedFaults / totalReferences, errorBound);
+
+            if (SAMPLE_VERIFY)
+            {
+                int exactFaults = simulateConfiguration(exactFile, originalWeighted, algorithms[a], frames, TICK);
+                int withinBound = fabs(estimatedFaults - exactFaults) <= errorBound;
+                releaseSimulator();
+
+                maximumError = fmax(maximumError, fabs(estimatedFaults - exactFaults) / totalReferences);
+                outsideBoundAmount += !withinBound;
+                fprintf(mrcFile, ",%d,%.6f,%d", exactFaults, (double)exactFaults / totalReferences, withinBound);
+            }
+            fprintf(mrcFile, "\n");
+        }
+    }
+
+    printf("Sampled %ld of %ld references (rate %g)\n", sampledReferences, totalReferences, SAMPLE_RATE);
+    if (SAMPLE_VERIFY)
+    {
+        printf("Maximum miss ratio error: %.6f, estimates outside error bound: %d\n", maximumError, outsideBoundAmount);
+    }
+
+    fclose(sampledFile);
+    fclose(mrcFile);
+    if (exactFile != NULL)
+    {
+        fclose(exactFile);
+    }
+}
+
+// Load a whole trace into memory so the concurrent runs measure the simulator, not parsing
+struct weightedReference *loadTrace(const char *filename, long *referenceAmount)
+{
+    char memoryReference[MEM_REF_MAX_SIZE];
+    long capacity = 1024;
+    struct weightedReference *references = (struct weightedReference *)malloc(sizeof(struct weightedReference) * capacity);
+
+    FILE *traceFile = fopen(filename, "r");
+    if (traceFile == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    *referenceAmount = 0;
+    while (fgets(memoryReference, MEM_REF_MAX_SIZE, traceFile) != NULL)
+    {
+        memoryReference[strcspn(memoryReference, "\n")] = 0;
+        if (*referenceAmount == capacity)
+        {
+            capacity *= 2;
+            references = (struct weightedReference *)realloc(references, sizeof(struct weightedReference) * capacity);
+        }
+
+        struct weightedReference *reference = &references[(*referenceAmount)++];
+        reference->value = 0;
+        reference->weight = 1;
+        reference->virtualAddress = referenceExtraction(memoryReference, &reference->mode, &reference->value);
+    }
+    fclose(traceFile);
+
+    return references;
+}
+
+void lockFrame(struct threadContext *context, int pfn)
+{
+    while (atomic_flag_test_and_set_explicit(&frameLocks[pfn], memory_order_acquire))
+    {
+        context->frameLockSpins++;
+        sched_yield();
+    }
+}
+
+void unlockFrame(int pfn)
+{
+    atomic_flag_clear_explicit(&frameLocks[pfn], memory_order_release);
+}
+
+// Set the R bits of buffered read hits in one batch instead of on every reference
+void flushReferenceBuffer(struct threadContext *context)
+{
+    for (int i = 0; i < context->referenceBufferAmount; i++)
+    {
+        unsigned short vpn = context->referenceBuffer[i];
+        unsigned short entry = atomic_load(&concurrentPageTable[vpn]);
+
+        if (extractBits(entry, 1, V_BIT_POSITION) == 1 && extractBits(entry, 1, R_BIT_POSITION) == 0)
+        {
+            atomic_fetch_or(&concurrentPageTable[vpn], 1 << R_BIT_POSITION);
+        }
+    }
+    context->referenceBufferAmount = 0;
+}
+
+// CLOCK over the shared frame pool: the hand is advanced with CAS, R bits are cleared with CAS
+// and a victim is claimed by setting its busy bit with CAS, so no thread ever holds a global lock
+int concurrentAcquireFrame(struct threadContext *context)
+{
+    if (atomic_load(&nextFreeFrame) < FRAME_NUMBER)
+    {
+        int pfn = atomic_fetch_add(&nextFreeFrame, 1);
+        if (pfn < FRAME_NUMBER)
+        {
+            return pfn;
+        }
+    }
+
+    while (1)
+    {
+        int pfn = atomic_load(&clockHand);
+        while (!atomic_compare_exchange_weak(&clockHand, &pfn, (pfn + 1) % FRAME_NUMBER))
+        {
+            context->handCasRetries++;
+        }
+
+        // Frame is being filled or emptied by another thread
+        int ownerVpn = atomic_load(&frameOwner[pfn]);
+        if (ownerVpn < 0)
+        {
+            continue;
+        }
+
+        unsigned short entry = atomic_load(&concurrentPageTable[ownerVpn]);
+        if (extractBits(entry, 1, V_BIT_POSITION) == 0 || extractBits(entry, 1, BUSY_BIT_POSITION) == 1 ||
+            extractBits(entry, PFN_BIT_SIZE, 0) != pfn)
+        {
+            continue;
+        }
+
+        // Second chance
+        if (extractBits(entry, 1, R_BIT_POSITION) == 1)
+        {
+            if (!atomic_compare_exchange_strong(&concurrentPageTable[ownerVpn], &entry, writeBits(entry, 1, R_BIT_POSITION, 0)))
+            {
+                context->referenceClearFailures++;
+            }
+            continue;
+        }
+
+        if (!atomic_compare_exchange_strong(&concurrentPageTable[ownerVpn], &entry, writeBits(entry, 1, BUSY_BIT_POSITION, 1)))
+        {
+            context->evictionClaimFailures++;
+            continue;
+        }
+
+        // Victim claimed: write it back if a writer modified it, then invalidate it
+        atomic_store(&frameOwner[pfn], -1);
+        lockFrame(context, pfn);
+        entry = atomic_load(&concurrentPageTable[ownerVpn]);
+        if (extractBits(entry, 1, M_BIT_POSITION) == 1)
+        {
+            pwrite(fileno(swapFile), physicalMemory[pfn].frameData, PAGE_SIZE_BYTES, (off_t)PAGE_SIZE_BYTES * ownerVpn);
+            context->writeBacks++;
+        }
+        atomic_store(&concurrentPageTable[ownerVpn], 0);
+        unlockFrame(pfn);
+
+        return pfn;
+    }
+}
+
+void concurrentReference(struct threadContext *context, struct weightedReference *reference)
+{
+    unsigned short vpn = extractBits(reference->virtualAddress, VA_VPN_BITS, VA_OFFSET_BITS);
+    unsigned short offset = extractBits(reference->virtualAddress, VA_OFFSET_BITS, 0);
+
+    while (1)
+    {
+        unsigned short entry = atomic_load(&concurrentPageTable[vpn]);
+        int pfn = extractBits(entry, PFN_BIT_SIZE, 0);
+
+        if (extractBits(entry, 1, BUSY_BIT_POSITION) == 1)
+        {
+            // Another thread is loading or evicting this page
+            context->faultWaits++;
+            sched_yield();
+            continue;
+        }
+
+        if (extractBits(entry, 1, V_BIT_POSITION) == 1)
+        {
+            if (reference->mode != 'w')
+            {
+                context->referenceBuffer[context->referenceBufferAmount++] = vpn;
+                if (context->referenceBufferAmount == THREAD_REFERENCE_BUFFER_SIZE)
+                {
+                    flushReferenceBuffer(context);
+                }
+                return;
+            }
+
+            // Writes touch the frame, so recheck the mapping under the frame lock
+            lockFrame(context, pfn);
+            entry = atomic_load(&concurrentPageTable[vpn]);
+            if (extractBits(entry, 1, V_BIT_POSITION) == 0 || extractBits(entry, 1, BUSY_BIT_POSITION) == 1 ||
+                extractBits(entry, PFN_BIT_SIZE, 0) != pfn)
+            {
+                unlockFrame(pfn);
+                continue;
+            }
+            physicalMemory[pfn].frameData[offset] = (char)reference->value;
+            atomic_fetch_or(&concurrentPageTable[vpn], (1 << R_BIT_POSITION) | (1 << M_BIT_POSITION));
+            unlockFrame(pfn);
+            return;
+        }
+
+        // Page fault: only the thread that marks the entry busy loads the page
+        if (!atomic_compare_exchange_strong(&concurrentPageTable[vpn], &entry, writeBits(entry, 1, BUSY_BIT_POSITION, 1)))
+        {
+            continue;
+        }
+        context->pageFaults++;
+
+        pfn = concurrentAcquireFrame(context);
+        lockFrame(context, pfn);
+        if (pread(fileno(swapFile), physicalMemory[pfn].frameData, PAGE_SIZE_BYTES, (off_t)PAGE_SIZE_BYTES * vpn) != PAGE_SIZE_BYTES)
+        {
+            memset(physicalMemory[pfn].frameData, 0, PAGE_SIZE_BYTES);
+        }
+
+        entry = writeBits(0, 1, V_BIT_POSITION, 1);
+        entry = writeBits(entry, 1, R_BIT_POSITION, 1);
+        entry = writeBits(entry, PFN_BIT_SIZE, 0, pfn);
+        if (reference->mode == 'w')
+        {
+            physicalMemory[pfn].frameData[offset] = (char)reference->value;
+            entry = writeBits(entry, 1, M_BIT_POSITION, 1);
+        }
+        atomic_store(&frameOwner[pfn], vpn);
+        atomic_store(&concurrentPageTable[vpn], entry);
+        unlockFrame(pfn);
+        return;
+    }
+}
+
+void *concurrentThread(void *argument)
+{
+    struct threadContext *context = (struct threadContext *)argument;
+
+    for (long i = 0; i < context->referenceAmount; i++)
+    {
+        concurrentReference(context, &context->references[i]);
+    }
+    flushReferenceBuffer(context);
+
+    return NULL;
+}
+
+// Run 1..THREAD_AMOUNT threads against one shared page table and frame pool and report the scaling
+void concurrentSimulation()
+{
+    struct threadContext contexts[CONCURRENT_MAX_THREADS];
+    struct weightedReference *traces[CONCURRENT_MAX_THREADS];
+    long traceLengths[CONCURRENT_MAX_THREADS];
+    double singleThreadThroughput = 0;
+
+    if (THREAD_TRACE_AMOUNT == 0)
+    {
+        strcpy(THREAD_TRACE_FILENAMES[THREAD_TRACE_AMOUNT++], REFERENCE_FILENAME);
+    }
+    for (int i = 0; i < THREAD_TRACE_AMOUNT; i++)
+    {
+        traces[i] = loadTrace(THREAD_TRACE_FILENAMES[i], &traceLengths[i]);
+    }
+
+    physicalMemory = (struct frame *)malloc(PAGE_SIZE_BYTES * FRAME_NUMBER);
+    concurrentPageTable = (_Atomic unsigned short *)malloc(sizeof(_Atomic unsigned short) * PAGE_AMOUNT);
+    frameOwner = (_Atomic int *)malloc(sizeof(_Atomic int) * FRAME_NUMBER);
+    frameLocks = (atomic_flag *)malloc(sizeof(atomic_flag) * FRAME_NUMBER);
+
+    fprintf(outputFile, "THREADS REFERENCES SECONDS REFS/SEC SPEEDUP PAGE_FAULTS WRITE_BACKS HAND_CAS_RETRIES"
+                        " R_CLEAR_CAS_FAILURES EVICTION_CLAIM_FAILURES FAULT_WAITS FRAME_LOCK_SPINS\n");
+
+    for (int threads = 1; threads <= THREAD_AMOUNT; threads++)
+    {
+        struct threadContext total;
+        struct timespec start;
+        struct timespec end;
+
+        // Every run starts cold, from an all-zero swap file
+        rewind(swapFile);
+        writeEmptySwapImage(swapFile);
+        fflush(swapFile);
         for (int i = 0; i < PAGE_AMOUNT; i++)
         {
-            if (extractBits(singlePageTable[i], 1, V_BIT_POSITION) == 1)
+            atomic_init(&concurrentPageTable[i], 0);
+        }
+        for (int i = 0; i < FRAME_NUMBER; i++)
+        {
+            atomic_init(&frameOwner[i], -1);
+            atomic_flag_clear(&frameLocks[i]);
+        }
+        atomic_init(&nextFreeFrame, 0);
+        atomic_init(&clockHand, 0);
+
+        memset(contexts, 0, sizeof(contexts));
+        memset(&total, 0, sizeof(total));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < threads; i++)
+        {
+            contexts[i].references = traces[i % THREAD_TRACE_AMOUNT];
+            contexts[i].referenceAmount = traceLengths[i % THREAD_TRACE_AMOUNT];
+            if (pthread_create(&contexts[i].thread, NULL, concurrentThread, &contexts[i]) != 0)
+            {
+                perror("pthread_create");
+                exit(1);
+            }
+        }
+        for (int i = 0; i < threads; i++)
+        {
+            pthread_join(contexts[i].thread, NULL);
+            total.referenceAmount += contexts[i].referenceAmount;
+            total.pageFaults += contexts[i].pageFaults;
+            total.writeBacks += contexts[i].writeBacks;
+            total.handCasRetries += contexts[i].handCasRetries;
+            total.referenceClearFailures += contexts[i].referenceClearFailures;
+            total.evictionClaimFailures += contexts[i].evictionClaimFailures;
+            total.faultWaits += contexts[i].faultWaits;
+            total.frameLockSpins += contexts[i].frameLockSpins;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        double throughput = total.referenceAmount / seconds;
+        if (threads == 1)
+        {
+            singleThreadThroughput = throughput;
+        }
+
+        fprintf(outputFile, "%d %ld %.6f %.0f %.2f %ld %ld %ld %ld %ld %ld %ld\n", threads, total.referenceAmount, seconds,
+                throughput, throughput / singleThreadThroughput, total.pageFaults, total.writeBacks, total.handCasRetries,
+                total.referenceClearFailures, total.evictionClaimFailures, total.faultWaits, total.frameLockSpins);
+    }
+
+    // Flush the frames of the last run to the swap file
+    for (int i = 0; i < PAGE_AMOUNT; i++)
+    {
+        unsigned short entry = atomic_load(&concurrentPageTable[i]);
+        if (extractBits(entry, 1, V_BIT_POSITION) == 1)
+        {
+            pwrite(fileno(swapFile), physicalMemory[extractBits(entry, PFN_BIT_SIZE, 0)].frameData, PAGE_SIZE_BYTES,
+                   (off_t)PAGE_SIZE_BYTES * i);
+        }
+    }
+
+    for (int i = 0; i < THREAD_TRACE_AMOUNT; i++)
+    {
+        free(traces[i]);
+    }
+    free(physicalMemory);
+    free((void *)concurrentPageTable);
+    free((void *)frameOwner);
+    free(frameLocks);
+}
+
+// Run one side of the differential mode on scratch files and stream its references and final swap contents
+void runDifferentialEngine(int referenceEngine, int pipeFd, int controlFd)
+{
+    char pageData[PAGE_SIZE_BYTES];
+    struct differentialRecord endRecord = {0, 0, -1, -1};
+
+    // The reference engine is the plain simulator with every optional path switched off
+    if (referenceEngine)
+    {
+        SPARSE_SWAP = 0;
+        HUGE_PAGE_THRESHOLD = 0;
+        TLB_ENTRIES = 0;
+        SLOW_FRAME_NUMBER = 0;
+        METRICS_INTERVAL = 0;
+        CHECKPOINT_INTERVAL = 0;
+    }
+    differentialEngineName = referenceEngine ? "reference" : "selected";
+
+    // Checkpoints need a name to rename to, kept out of the way of the user's checkpoint file,
+    // and every one of them is restored at once to check the resumed run
+    if (CHECKPOINT_INTERVAL > 0)
+    {
+        sprintf(CHECKPOINT_FILENAME, "/tmp/memsim-diff-%d.ck", (int)getpid());
+        strcpy(RESUME_FILENAME, CHECKPOINT_FILENAME);
+    }
+
+    initializeSimulator();
+
+    differentialPipe = fdopen(pipeFd, "w");
+    differentialControl = controlFd;
+    swapFile = tmpfile();
+    outputFile = tmpfile();
+    metricsFile = METRICS_INTERVAL > 0 ? tmpfile() : NULL;
+    referenceFile = fopen(REFERENCE_FILENAME, "r");
+    if (differentialPipe == NULL || swapFile == NULL || outputFile == NULL || referenceFile == NULL ||
+        (METRICS_INTERVAL > 0 && metricsFile == NULL))
+    {
+        perror("fopen");
+        exit(1);
+    }
+    resetSwapStore();
+    if (metricsFile != NULL)
+    {
+        writeMetricsHeader();
+    }
+
+    processMemoryReferences();
+    if (metricsFile != NULL && totalReferenceCounter > windowReferenceStart)
+    {
+        sampleMetrics();
+    }
+    memoryFlush();
+    reportDifferentialRecord(&endRecord);
+
+    if (metricsFile != NULL)
+    {
+        flushMetrics();
+        fclose(metricsFile);
+    }
+    if (CHECKPOINT_INTERVAL > 0)
+    {
+        remove(CHECKPOINT_FILENAME);
+    }
+
+    // Logical swap contents, whatever the layout of the store
+    for (int i = 0; i < PAGE_AMOUNT; i++)
+    {
+        swapRead(i, pageData);
+        fwrite(pageData, PAGE_SIZE_BYTES, 1, differentialPipe);
+    }
+
+    fclose(differentialPipe);
+    exit(EXIT_SUCCESS);
+}
+
+void printDifferentialRecord(const char *engine, struct differentialRecord *record)
+{
+    if (record->pageFault < 0)
+    {
+        printf("  %s end of trace\n", engine);
+        return;
+    }
+
+    printf("  %s pfn 0x%hx%s", engine, record->pfn, record->pageFault == 1 ? " pgfault" : "");
+    if (record->victimVpn >= 0)
+    {
+        printf(" victim vpn 0x%x", record->victimVpn);
+    }
+    printf("\n");
+}
+
+// Run the reference engine and the selected configuration in lockstep and stop at their first difference
+int differentialCheck()
+{
+    int pipes[2][2];
+    int controls[2][2];
+    pid_t engines[2];
+    FILE *streams[2];
+    struct differentialRecord records[2];
+    char pageData[2][PAGE_SIZE_BYTES];
+    long reference = 0;
+    int matched = 1;
+
+    // Children inherit the stdio buffers
+    fflush(stdout);
+
+    for (int engine = 0; engine < 2; engine++)
+    {
+        if (pipe(pipes[engine]) != 0 || pipe(controls[engine]) != 0)
+        {
+            perror("pipe");
+            exit(1);
+        }
+
+        engines[engine] = fork();
+        if (engines[engine] < 0)
+        {
+            perror("fork");
+            exit(1);
+        }
+        if (engines[engine] == 0)
+        {
+            close(pipes[engine][0]);
+            close(controls[engine][1]);
+            if (engine == 1)
+            {
+                close(pipes[0][0]);
+                close(controls[0][1]);
+            }
+            runDifferentialEngine(engine == 0, pipes[engine][1], controls[engine][0]);
+        }
+
+        close(pipes[engine][1]);
+        close(controls[engine][0]);
+        streams[engine] = fdopen(pipes[engine][0], "r");
+    }
+
+    // Both engines stop after every record until they are told to go on
+    while (1)
+    {
+        for (int engine = 0; engine < 2; engine++)
+        {
+            if (fread(&records[engine], sizeof(records[engine]), 1, streams[engine]) != 1)
+            {
+                fprintf(stderr, "Error: Differential engine %d stopped unexpectedly.\n", engine);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        matched = records[0].pageFault == records[1].pageFault &&
+                  (records[0].pageFault < 0 || (records[0].pfn == records[1].pfn && records[0].victimVpn == records[1].victimVpn));
+        if (!matched)
+        {
+            break;
+        }
+
+        for (int engine = 0; engine < 2; engine++)
+        {
+            if (write(controls[engine][1], "c", 1) != 1)
             {
-                extractedFrame = extractBits(singlePageTable[i], PFN_BIT_SIZE, 0);
+                perror("write");
+                exit(1);
+            }
+        }
+
+        if (records[0].pageFault < 0)
+        {
+            break;
+        }
+        reference++;
+    }
 
-                fseek(swapFile, PAGE_SIZE_BYTES * i, SEEK_SET);
-                fwrite(physicalMemory[extractedFrame].frameData, PAGE_SIZE_BYTES, 1, swapFile);
+    if (!matched)
+    {
+        printf("Differential check: mismatch at reference %ld (virtual address 0x%04hx)\n", reference + 1,
+               records[records[0].pageFault < 0 ? 1 : 0].virtualAddress);
+        printDifferentialRecord("reference engine:", &records[0]);
+        printDifferentialRecord("selected engine: ", &records[1]);
+        fflush(stdout);
+
+        // One engine at a time, so their dumps do not interleave
+        for (int engine = 0; engine < 2; engine++)
+        {
+            if (write(controls[engine][1], "d", 1) != 1)
+            {
+                perror("write");
+                exit(1);
             }
+            waitpid(engines[engine], NULL, 0);
+            engines[engine] = 0;
         }
     }
-    else if (PAGE_OPTION == 2)
+
+    // Compare the final swap contents page by page
+    for (int i = 0; i < PAGE_AMOUNT && matched; i++)
     {
-        unsigned short tmpVirtualAddress = 0x0000;
-        unsigned short extractedVpn;
-        unsigned short extractedFrame;
-        for (int i = 0; i < INNER_TABLE_AMOUNT; i++)
+        for (int engine = 0; engine < 2; engine++)
         {
-            if (extractBits(outerPageTable[i], 1, V_BIT_POSITION) == 1)
+            if (fread(pageData[engine], PAGE_SIZE_BYTES, 1, streams[engine]) != 1)
             {
-                // Write VPN_P1
-                tmpVirtualAddress = writeBits(tmpVirtualAddress, TWO_LEVEL_VPN_P1_BITS, TWO_LEVEL_VPN_P2_BITS + VA_OFFSET_BITS, i);
-                for (int j = 0; j < INNER_TABLE_PAGE_SIZE; j++)
-                {
-                    if (innerTablesTable[i] != NULL)
-                    {
-                        // Write VPN_P2
-                        tmpVirtualAddress = writeBits(tmpVirtualAddress, TWO_LEVEL_VPN_P2_BITS, VA_OFFSET_BITS, j);
-                        if (extractBits((innerTablesTable[i])[j], 1, V_BIT_POSITION) == 1)
-                        {
-                            extractedVpn = extractBits(tmpVirtualAddress, VA_VPN_BITS, VA_OFFSET_BITS);
-                            extractedFrame = extractBits((innerTablesTable[i])[j], PFN_BIT_SIZE, 0);
+                fprintf(stderr, "Error: Differential engine %d stopped unexpectedly.\n", engine);
+                exit(EXIT_FAILURE);
+            }
+        }
 
-                            fseek(swapFile, PAGE_SIZE_BYTES * extractedVpn, SEEK_SET);
-                            fwrite(physicalMemory[extractedFrame].frameData, PAGE_SIZE_BYTES, 1, swapFile);
-                        }
-                    }
-                }
+        for (int j = 0; j < PAGE_SIZE_BYTES && matched; j++)
+        {
+            if (pageData[0][j] != pageData[1][j])
+            {
+                printf("Differential check: final swap page 0x%x differs at byte %d (0x%02hhx / 0x%02hhx)\n",
+                       i, j, pageData[0][j], pageData[1][j]);
+                matched = 0;
             }
         }
     }
+
+    // Engines still writing swap pages after a mismatch are not needed any more
+    for (int engine = 0; engine < 2; engine++)
+    {
+        if (engines[engine] > 0 && !matched)
+        {
+            kill(engines[engine], SIGTERM);
+        }
+        fclose(streams[engine]);
+        close(controls[engine][1]);
+        if (engines[engine] > 0)
+        {
+            waitpid(engines[engine], NULL, 0);
+        }
+    }
+
+    if (matched)
+    {
+        printf("Differential check: %ld references and the final swap contents: MATCH\n", reference);
+    }
+    return matched;
 }
 
 int main(int argc, char *argv[])
 {
+    static struct option longOptions[] = {
+        {"checkpoint", required_argument, NULL, OPT_CHECKPOINT},
+        {"checkpoint-every", required_argument, NULL, OPT_CHECKPOINT_EVERY},
+        {"resume", required_argument, NULL, OPT_RESUME},
+        {"reduce", required_argument, NULL, OPT_REDUCE},
+        {"reduce-frames", required_argument, NULL, OPT_REDUCE_FRAMES},
+        {"weighted", no_argument, NULL, OPT_WEIGHTED},
+        {"validate-reduced", required_argument, NULL, OPT_VALIDATE_REDUCED},
+        {"sample-rate", required_argument, NULL, OPT_SAMPLE_RATE},
+        {"mrc", required_argument, NULL, OPT_MRC},
+        {"sample-verify", no_argument, NULL, OPT_SAMPLE_VERIFY},
+        {"huge-pages", required_argument, NULL, OPT_HUGE_PAGES},
+        {"tlb-entries", required_argument, NULL, OPT_TLB_ENTRIES},
+        {"sparse-swap", no_argument, NULL, OPT_SPARSE_SWAP},
+        {"metrics", required_argument, NULL, OPT_METRICS},
+        {"metrics-every", required_argument, NULL, OPT_METRICS_EVERY},
+        {"metrics-format", required_argument, NULL, OPT_METRICS_FORMAT},
+        {"threads", required_argument, NULL, OPT_THREADS},
+        {"thread-trace", required_argument, NULL, OPT_THREAD_TRACE},
+        {"slow-frames", required_argument, NULL, OPT_SLOW_FRAMES},
+        {"fast-cost", required_argument, NULL, OPT_FAST_COST},
+        {"slow-cost", required_argument, NULL, OPT_SLOW_COST},
+        {"fault-cost", required_argument, NULL, OPT_FAULT_COST},
+        {"diff", no_argument, NULL, OPT_DIFF},
+        {NULL, 0, NULL, 0}};
+
+    int exitStatus = EXIT_SUCCESS;
     int option;
-    while ((option = getopt(argc, argv, "p:r:s:f:a:t:o:")) != -1)
+    while ((option = getopt_long(argc, argv, "p:r:s:f:a:t:o:", longOptions, NULL)) != -1)
     {
         switch (option)
         {
@@ -524,67 +3131,309 @@ int main(int argc, char *argv[])
             }
             strcpy(OUTPUT_FILENAME, optarg);
             break;
+        case OPT_CHECKPOINT:
+            if (optarg == NULL || strcmp(optarg, "") == 0 || optarg[0] == '-')
+            {
+                fprintf(stderr, "Error: Checkpoint file name must not be NULL.\n");
+                exit(EXIT_FAILURE);
+            }
+            strcpy(CHECKPOINT_FILENAME, optarg);
+            break;
+        case OPT_CHECKPOINT_EVERY:
+            CHECKPOINT_INTERVAL = atol(optarg);
+            if (CHECKPOINT_INTERVAL < 1)
+            {
+                fprintf(stderr, "Error: Minimum value for checkpoint interval is 1.\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_RESUME:
+            if (optarg == NULL || strcmp(optarg, "") == 0 || optarg[0] == '-')
+            {
+                fprintf(stderr, "Error: Resume file name must not be NULL.\n");
+                exit(EXIT_FAILURE);
+            }
+            strcpy(RESUME_FILENAME, optarg);
+            break;
+        case OPT_REDUCE:
+            if (optarg == NULL || strcmp(optarg, "") == 0 || optarg[0] == '-')
+            {
+                fprintf(stderr, "Error: Reduced trace file name must not be NULL.\n");
+                exit(EXIT_FAILURE);
+            }
+            strcpy(REDUCED_FILENAME, optarg);
+            break;
+        case OPT_REDUCE_FRAMES:
+            REDUCE_FRAMES = atoi(optarg);
+            if (REDUCE_FRAMES < 1 || REDUCE_FRAMES > 128)
+            {
+                fprintf(stderr, "Error: Minimum and maximum values for reduce frames are 1 and 128.\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_WEIGHTED:
+            WEIGHTED_TRACE = 1;
+            break;
+        case OPT_VALIDATE_REDUCED:
+            if (optarg == NULL || strcmp(optarg, "") == 0 || optarg[0] == '-')
+            {
+                fprintf(stderr, "Error: Validation file name must not be NULL.\n");
+                exit(EXIT_FAILURE);
+            }
+            strcpy(VALIDATE_FILENAME, optarg);
+            break;
+        case OPT_SAMPLE_RATE:
+            SAMPLE_RATE = atof(optarg);
+            if (SAMPLE_RATE <= 0 || SAMPLE_RATE > 1)
+            {
+                fprintf(stderr, "Error: Sample rate must be greater than 0 and at most 1.\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_MRC:
+            if (optarg == NULL || strcmp(optarg, "") == 0 || optarg[0] == '-')
+            {
+                fprintf(stderr, "Error: Miss ratio curve file name must not be NULL.\n");
+                exit(EXIT_FAILURE);
+            }
+            strcpy(MRC_FILENAME, optarg);
+            break;
+        case OPT_SAMPLE_VERIFY:
+            SAMPLE_VERIFY = 1;
+            break;
+        case OPT_HUGE_PAGES:
+            HUGE_PAGE_THRESHOLD = atoi(optarg);
+            if (HUGE_PAGE_THRESHOLD < 1 || HUGE_PAGE_THRESHOLD > 32)
+            {
+                fprintf(stderr, "Error: Minimum and maximum values for huge page threshold are 1 and 32.\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_TLB_ENTRIES:
+            TLB_ENTRIES = atoi(optarg);
+            if (TLB_ENTRIES < 1 || TLB_ENTRIES > TLB_MAX_ENTRIES)
+            {
+                fprintf(stderr, "Error: Minimum and maximum values for TLB entries are 1 and %d.\n", TLB_MAX_ENTRIES);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_SPARSE_SWAP:
+            SPARSE_SWAP = 1;
+            break;
+        case OPT_METRICS:
+            if (optarg == NULL || strcmp(optarg, "") == 0 || optarg[0] == '-')
+            {
+                fprintf(stderr, "Error: Metrics file name must not be NULL.\n");
+                exit(EXIT_FAILURE);
+            }
+            strcpy(METRICS_FILENAME, optarg);
+            break;
+        case OPT_METRICS_EVERY:
+            METRICS_INTERVAL = atol(optarg);
+            if (METRICS_INTERVAL < 1)
+            {
+                fprintf(stderr, "Error: Minimum value for metrics interval is 1.\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_METRICS_FORMAT:
+            if (strcmp(optarg, "csv") != 0 && strcmp(optarg, "json") != 0)
+            {
+                fprintf(stderr, "Error: Metrics format must be csv or json.\n");
+                exit(EXIT_FAILURE);
+            }
+            METRICS_JSON = strcmp(optarg, "json") == 0;
+            break;
+        case OPT_THREADS:
+            THREAD_AMOUNT = atoi(optarg);
+            if (THREAD_AMOUNT < 1 || THREAD_AMOUNT > CONCURRENT_MAX_THREADS)
+            {
+                fprintf(stderr, "Error: Minimum and maximum values for threads are 1 and %d.\n", CONCURRENT_MAX_THREADS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_THREAD_TRACE:
+            if (optarg == NULL || strcmp(optarg, "") == 0 || optarg[0] == '-')
+            {
+                fprintf(stderr, "Error: Thread trace file name must not be NULL.\n");
+                exit(EXIT_FAILURE);
+            }
+            if (THREAD_TRACE_AMOUNT == CONCURRENT_MAX_THREADS)
+            {
+                fprintf(stderr, "Error: At most %d thread traces can be given.\n", CONCURRENT_MAX_THREADS);
+                exit(EXIT_FAILURE);
+            }
+            strcpy(THREAD_TRACE_FILENAMES[THREAD_TRACE_AMOUNT++], optarg);
+            break;
+        case OPT_SLOW_FRAMES:
+            SLOW_FRAME_NUMBER = atoi(optarg);
+            if (SLOW_FRAME_NUMBER < 1 || SLOW_FRAME_NUMBER > PAGE_AMOUNT - 128)
+            {
+                fprintf(stderr, "Error: Minimum and maximum values for slow frames are 1 and %d.\n", PAGE_AMOUNT - 128);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case OPT_FAST_COST:
+        case OPT_SLOW_COST:
+        case OPT_FAULT_COST:
+            if (atof(optarg) < 0)
+            {
+                fprintf(stderr, "Error: Access costs must not be negative.\n");
+                exit(EXIT_FAILURE);
+            }
+            *(option == OPT_FAST_COST ? &FAST_ACCESS_COST : option == OPT_SLOW_COST ? &SLOW_ACCESS_COST : &FAULT_ACCESS_COST) = atof(optarg);
+            break;
+        case OPT_DIFF:
+            DIFFERENTIAL = 1;
+            break;
         default:
-            fprintf(stderr, "Usage: %s -p level -r addrfile -s swapfile -f fcount -a algo -t tick -o outfile\n", argv[0]);
+            fprintf(stderr, "Usage: %s -p level -r addrfile -s swapfile -f fcount -a algo -t tick -o outfile"
+                            " [--checkpoint file --checkpoint-every n] [--resume file] [--weighted]"
+                            " [--validate-reduced reducedfile] [--huge-pages threshold] [--tlb-entries n]"
+                            " [--sparse-swap] [--metrics file --metrics-every n [--metrics-format csv|json]]"
+                            " [--slow-frames n [--fast-cost ns] [--slow-cost ns] [--fault-cost ns]]\n"
+                            "       %s -p level -r addrfile -f fcount -a algo -t tick --diff [--sparse-swap] [--tlb-entries n]"
+                            " [--metrics file --metrics-every n] [--checkpoint file --checkpoint-every n]\n"
+                            "       %s -s swapfile -f fcount -a CLOCK -o outfile --threads n [--thread-trace addrfile ...]\n"
+                            "       %s -r addrfile --reduce reducedfile [--reduce-frames fcount]\n"
+                            "       %s -p level -r addrfile -t tick [-a algo] [--weighted] --mrc csvfile"
+                            " [--sample-rate rate] [--sample-verify]\n",
+                    argv[0], argv[0], argv[0], argv[0], argv[0]);
             exit(EXIT_FAILURE);
         }
     }
 
+    // Offline trace reduction does not simulate anything
+    if (strcmp(REDUCED_FILENAME, "") != 0)
+    {
+        reduceTrace();
+        exit(EXIT_SUCCESS);
+    }
+
+    if (CHECKPOINT_INTERVAL > 0 && strcmp(CHECKPOINT_FILENAME, "") == 0)
+    {
+        fprintf(stderr, "Error: --checkpoint-every requires --checkpoint.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (strcmp(CHECKPOINT_FILENAME, "") != 0 && CHECKPOINT_INTERVAL == 0)
+    {
+        fprintf(stderr, "Error: --checkpoint requires --checkpoint-every.\n");
+        exit(EXIT_FAILURE);
+    }
+
     PFN_BIT_SIZE = (int)ceil(log2((double)FRAME_NUMBER));
     INNER_TABLE_AMOUNT = (int)pow(2, TWO_LEVEL_VPN_P1_BITS);
     INNER_TABLE_PAGE_SIZE = (int)pow(2, TWO_LEVEL_VPN_P2_BITS);
 
-    lruListHead = NULL;
-    lruListTail = NULL;
-    circularListHead = NULL;
+    if ((METRICS_INTERVAL > 0) != (strcmp(METRICS_FILENAME, "") != 0))
+    {
+        fprintf(stderr, "Error: --metrics and --metrics-every must be given together.\n");
+        exit(EXIT_FAILURE);
+    }
 
-    initialFrameCounter = 0;
-    referenceCounter = 0;
-    totalPageFaultCounter = 0;
+    if (HUGE_PAGE_THRESHOLD > 0 && (PAGE_OPTION != 2 || FRAME_NUMBER < INNER_TABLE_PAGE_SIZE))
+    {
+        fprintf(stderr, "Error: Huge pages need -p 2 and at least %d frames.\n", INNER_TABLE_PAGE_SIZE);
+        exit(EXIT_FAILURE);
+    }
 
-    physicalMemory = (struct frame *)malloc(PAGE_SIZE_BYTES * FRAME_NUMBER);
-    singlePageTable = (unsigned short *)malloc(sizeof(unsigned short) * PAGE_AMOUNT);
-    outerPageTable = (unsigned short *)malloc(sizeof(unsigned short) * INNER_TABLE_AMOUNT);
-    innerTablesTable = (unsigned short **)malloc(sizeof(unsigned short *) * INNER_TABLE_AMOUNT);
+    if (SLOW_FRAME_NUMBER > 0 && TICK == 0)
+    {
+        fprintf(stderr, "Error: The slow tier needs a tick greater than 0 to promote pages.\n");
+        exit(EXIT_FAILURE);
+    }
 
-    // Initialize Swap File
-    swapFile = fopen(SWAPFILE_FILENAME, "r+");
-    if (swapFile == NULL)
+    // Promotion at a tick inside a reduced record sees replacement state the collapsed record does not reproduce,
+    // and sampling scales the fast frames but not the slow ones
+    if (SLOW_FRAME_NUMBER > 0 && (WEIGHTED_TRACE || strcmp(VALIDATE_FILENAME, "") != 0 || strcmp(MRC_FILENAME, "") != 0))
     {
-        swapFile = fopen(SWAPFILE_FILENAME, "w+");
-        if (swapFile == NULL)
+        fprintf(stderr, "Error: The slow tier cannot be combined with --weighted, --validate-reduced or --mrc.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Miss ratio curves run their own scratch simulations
+    if (strcmp(MRC_FILENAME, "") != 0)
+    {
+        // Promotion depends on the frame count, which sampling scales down
+        if (HUGE_PAGE_THRESHOLD > 0)
         {
-            perror("fopen");
-            exit(1);
+            fprintf(stderr, "Error: Miss ratio curves cannot be combined with --huge-pages.\n");
+            exit(EXIT_FAILURE);
         }
-
-        char intialData[VM_SIZE_BYTES];
-
-        for (int i = 0; i < VM_SIZE_BYTES; i++)
+        if (SAMPLE_RATE == 0)
         {
-            intialData[i] = 0;
+            SAMPLE_RATE = 1;
         }
-
-        fwrite(intialData, sizeof(intialData), 1, swapFile);
+        sampledMissRatioCurves();
+        exit(EXIT_SUCCESS);
     }
 
-    // Initialize Single Page Table
-    unsigned short zeroMask = 0x0000;
-    for (int i = 0; i < PAGE_AMOUNT; i++)
+    // Differential mode runs the reference engine and the selected configuration side by side
+    if (DIFFERENTIAL)
     {
-        singlePageTable[i] &= zeroMask;
+        // Only paths meant to keep the results identical can be checked: a reduced trace would be compared
+        // against itself, huge pages and the slow tier change PFNs and faults by design
+        if (THREAD_AMOUNT > 0 || strcmp(RESUME_FILENAME, "") != 0 || WEIGHTED_TRACE ||
+            HUGE_PAGE_THRESHOLD > 0 || SLOW_FRAME_NUMBER > 0)
+        {
+            fprintf(stderr, "Error: Differential mode cannot be combined with --threads, --resume, --weighted,"
+                            " --huge-pages or --slow-frames.\n");
+            exit(EXIT_FAILURE);
+        }
+        exit(differentialCheck() ? EXIT_SUCCESS : EXIT_FAILURE);
     }
 
-    // Initialize Outer Page Table
-    for (int i = 0; i < INNER_TABLE_AMOUNT; i++)
+    // Concurrent mode runs its own engine on a flat shared page table
+    if (THREAD_AMOUNT > 0)
     {
-        outerPageTable[i] &= zeroMask;
+        if (strcmp(ALGORITHM_NAME, "CLOCK") != 0 || SPARSE_SWAP || SLOW_FRAME_NUMBER > 0)
+        {
+            fprintf(stderr, "Error: Concurrent mode supports -a CLOCK with the fixed swap layout and no slow tier only.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        // The concurrent engine replays plain traces on a flat table with no tick and no observers
+        if (PAGE_OPTION == 2 || TICK > 0 || WEIGHTED_TRACE || HUGE_PAGE_THRESHOLD > 0 || TLB_ENTRIES > 0 ||
+            CHECKPOINT_INTERVAL > 0 || strcmp(RESUME_FILENAME, "") != 0 || METRICS_INTERVAL > 0 ||
+            strcmp(VALIDATE_FILENAME, "") != 0)
+        {
+            fprintf(stderr, "Error: Concurrent mode cannot be combined with -p 2, -t, --weighted, --huge-pages, --tlb-entries,"
+                            " --checkpoint, --resume, --metrics or --validate-reduced.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        swapFile = fopen(SWAPFILE_FILENAME, "w+");
+        outputFile = fopen(OUTPUT_FILENAME, "w+");
+        if (swapFile == NULL || outputFile == NULL)
+        {
+            perror("fopen");
+            exit(1);
+        }
+        concurrentSimulation();
+        fclose(swapFile);
+        fclose(outputFile);
+        exit(EXIT_SUCCESS);
     }
 
-    // Assign Inner Tables Table to NULL
-    for (int i = 0; i < INNER_TABLE_AMOUNT; i++)
+    initializeSimulator();
+
+    // Initialize Swap File (an existing sparse store is only reused together with its index)
+    swapFile = fopen(SWAPFILE_FILENAME, "r+");
+    if (swapFile != NULL && SPARSE_SWAP && !loadSwapIndex())
     {
-        innerTablesTable[i] = NULL;
+        fclose(swapFile);
+        swapFile = NULL;
+    }
+    if (swapFile == NULL)
+    {
+        swapFile = fopen(SWAPFILE_FILENAME, "w+");
+        if (swapFile == NULL)
+        {
+            perror("fopen");
+            exit(1);
+        }
+
+        resetSwapStore();
     }
 
     // Open Reference File
@@ -594,39 +3443,126 @@ int main(int argc, char *argv[])
         perror("fopen");
         exit(1);
     }
+    if (WEIGHTED_TRACE)
+    {
+        readReducedTraceHeader();
+    }
 
-    // Open Output File
-    outputFile = fopen(OUTPUT_FILENAME, "w+");
-    if (outputFile == NULL)
+    // Restore the simulator state and trace position from a checkpoint
+    if (strcmp(RESUME_FILENAME, "") != 0)
     {
-        perror("fopen");
-        exit(1);
+        restoreCheckpoint();
+    }
+
+    // Open Output File (on resume, keep the log written up to the checkpoint if it is still there)
+    int outputContinued;
+    outputFile = openResumableFile(OUTPUT_FILENAME, resumeOutputOffset, &outputContinued);
+
+    // Open Metrics File
+    if (METRICS_INTERVAL > 0)
+    {
+        int metricsContinued;
+        metricsFile = openResumableFile(METRICS_FILENAME, resumeMetricsOffset, &metricsContinued);
+        if (!metricsContinued)
+        {
+            writeMetricsHeader();
+        }
     }
 
     // Process all memory references in the address file
     processMemoryReferences();
 
+    // The trailing partial window is sampled too
+    if (metricsFile != NULL && totalReferenceCounter > windowReferenceStart)
+    {
+        sampleMetrics();
+    }
+
     // Flush all valid table entries' corresponding frames to the swapfile
     memoryFlush();
 
+    if (metricsFile != NULL)
+    {
+        flushMetrics();
+        fclose(metricsFile);
+        metricsFile = NULL;
+    }
+
+    if (SPARSE_SWAP)
+    {
+        writeSwapIndex();
+    }
+
     // Write total page fault count to the output file
     fprintf(outputFile, "\n TOTAL NUMBER OF PAGE FAULTS: %d\n", totalPageFaultCounter);
+    if (HUGE_PAGE_THRESHOLD > 0)
+    {
+        fprintf(outputFile, " HUGE PAGE PROMOTIONS: %d DEMOTIONS: %d PREFETCHED PAGES: %d\n",
+                promotionCounter, demotionCounter, prefetchCounter);
+    }
+    if (SPARSE_SWAP)
+    {
+        fprintf(outputFile, " SWAP SLOTS: %d FILE SIZE: %ld BYTES ZERO-FILLED PAGES: %ld\n", swapSlotAmount - freeSlotAmount,
+                (long)PAGE_SIZE_BYTES * swapSlotAmount, zeroFillCounter);
+    }
+    if (TLB_ENTRIES > 0)
+    {
+        fprintf(outputFile, " TLB HITS: %ld MISSES: %ld AVERAGE REACH: %.0f BYTES\n", tlbHitCounter, tlbMissCounter,
+                totalReferenceCounter > 0 ? tlbReachSum / totalReferenceCounter : 0);
+    }
+    if (SLOW_FRAME_NUMBER > 0)
+    {
+        fprintf(outputFile, " FAST ACCESSES: %ld SLOW ACCESSES: %ld TIER PROMOTIONS: %d DEMOTIONS: %d SLOW EVICTIONS: %d\n",
+                fastAccessCounter, slowAccessCounter, tierPromotionCounter, tierDemotionCounter, slowEvictionCounter);
+        fprintf(outputFile, " AVERAGE ACCESS COST: %.1f NS\n", totalReferenceCounter > 0 ? accessCostSum / totalReferenceCounter : 0);
+    }
 
-    // Clean Up
-    for (int i = 0; i < INNER_TABLE_AMOUNT; i++)
+    // Replay the reduced trace from scratch and check it reaches the same fault count
+    if (strcmp(VALIDATE_FILENAME, "") != 0)
     {
-        if (innerTablesTable[i] != NULL)
+        int originalPageFaultCounter = totalPageFaultCounter;
+
+        releaseSimulator();
+        initializeSimulator();
+
+        fclose(referenceFile);
+        fclose(swapFile);
+        strcpy(REFERENCE_FILENAME, VALIDATE_FILENAME);
+        referenceFile = fopen(REFERENCE_FILENAME, "r");
+        swapFile = tmpfile();
+        FILE *validationOutputFile = tmpfile();
+        if (referenceFile == NULL || swapFile == NULL || validationOutputFile == NULL)
         {
-            free(innerTablesTable[i]);
+            perror("fopen");
+            exit(1);
+        }
+        resetSwapStore();
+
+        FILE *originalOutputFile = outputFile;
+        outputFile = validationOutputFile;
+        WEIGHTED_TRACE = 1;
+        CHECKPOINT_INTERVAL = 0;
+        METRICS_INTERVAL = 0;
+        readReducedTraceHeader();
+        processMemoryReferences();
+        outputFile = originalOutputFile;
+        fclose(validationOutputFile);
+
+        printf("Original trace: %d page faults, reduced trace: %d page faults: %s\n",
+               originalPageFaultCounter, totalPageFaultCounter,
+               originalPageFaultCounter == totalPageFaultCounter ? "MATCH" : "MISMATCH");
+        if (originalPageFaultCounter != totalPageFaultCounter)
+        {
+            exitStatus = EXIT_FAILURE;
         }
     }
 
-    free(physicalMemory);
-    free(singlePageTable);
-    free(outerPageTable);
-    free(innerTablesTable);
+    // Clean Up
+    releaseSimulator();
 
     fclose(swapFile);
     fclose(referenceFile);
     fclose(outputFile);
+
+    return exitStatus;
 }
\ No newline at end of file